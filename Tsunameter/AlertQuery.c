@@ -0,0 +1,257 @@
+/*
+    Query tool for the alert store written by the base station.
+
+    Usage:
+        alertquery <store> summary
+        alertquery <store> rate <sensor> <t1> <t2>
+        alertquery <store> dump <sensor> <t1> <t2>
+
+    Times are unix timestamps in seconds (e.g. from `date +%s`). The data file and the
+    sorted index are memory mapped. A query binary searches the blocks of its sensor and
+    time range, so only those blocks are touched. Without the sorted index (the run did not
+    close the store) the index file is sorted in memory first.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "AlertStore.h"
+
+//A memory mapped file
+struct mappedFile{
+    char *data;
+    size_t size;
+};
+
+//Map the whole file read only. Returns 0 on success, -1 on error
+int mapFile(const char *path, struct mappedFile *mapped){
+    struct stat fileStat;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return -1;
+    if (fstat(fd, &fileStat) != 0){
+        close(fd);
+        return -1;
+    }
+
+    mapped->size = fileStat.st_size;
+    mapped->data = NULL;
+    if (mapped->size > 0){
+        mapped->data = mmap(NULL, mapped->size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapped->data == MAP_FAILED){
+            close(fd);
+            return -1;
+        }
+    }
+    close(fd);
+    return 0;
+}
+
+//Index grouped by sensor and ordered by time. Either points into the mapped sorted index or is sorted in memory
+struct sortedIndex{
+    struct storeIndexEntry *entries;
+    int64_t numEntries;
+    int64_t *start;          //entries of sensor s are [start[s], start[s+1])
+    int64_t *maxTimeSoFar;
+    int numSensors;
+    int allocated;           //1 if sorted in memory and must be freed
+};
+
+//Use the sorted index if it matches the index file, else sort the index file in memory. Returns 0 on success
+int loadIndex(const char *path, struct storeHeader *header, struct mappedFile *indexFile, struct mappedFile *sortedFile, struct sortedIndex *index){
+    char sortedPath[512];
+    int64_t numEntries = indexFile->size / sizeof(struct storeIndexEntry);
+    index->numSensors = header->numSensors;
+    index->numEntries = numEntries;
+    index->allocated = 0;
+
+    snprintf(sortedPath, sizeof(sortedPath), "%s%s", path, STORE_SORTED_SUFFIX);
+    sortedFile->data = NULL;
+    if (mapFile(sortedPath, sortedFile) == 0){
+        struct storeSortedHeader *sortedHeader = (struct storeSortedHeader*)sortedFile->data;
+        size_t expected = sizeof(struct storeSortedHeader) + (header->numSensors + 1) * sizeof(int64_t) + numEntries * (sizeof(struct storeIndexEntry) + sizeof(int64_t));
+        if (sortedFile->size == expected && memcmp(sortedHeader->magic, STORE_SORTED_MAGIC, 8) == 0 && sortedHeader->numSensors == header->numSensors && sortedHeader->numEntries == numEntries){
+            index->start = (int64_t*)(sortedFile->data + sizeof(struct storeSortedHeader));
+            index->entries = (struct storeIndexEntry*)(index->start + header->numSensors + 1);
+            index->maxTimeSoFar = (int64_t*)(index->entries + numEntries);
+            return 0;
+        }
+    }
+    else
+        sortedFile->data = NULL;
+
+    printf("NOTE: no sorted index for %s, sorting %lld index entries\n", path, (long long)numEntries);
+    index->entries = (struct storeIndexEntry*)malloc((numEntries > 0 ? numEntries : 1) * sizeof(struct storeIndexEntry));
+    index->start = (int64_t*)malloc((header->numSensors + 1) * sizeof(int64_t));
+    index->maxTimeSoFar = (int64_t*)malloc((numEntries > 0 ? numEntries : 1) * sizeof(int64_t));
+    if (index->entries == NULL || index->start == NULL || index->maxTimeSoFar == NULL)
+        return -1;
+    if (numEntries > 0)
+        memcpy(index->entries, indexFile->data, numEntries * sizeof(struct storeIndexEntry));
+    storeSortIndex(index->entries, numEntries, header->numSensors, index->start, index->maxTimeSoFar);
+    index->allocated = 1;
+    return 0;
+}
+
+//Range [*first, *last) of the sensor's entries which may hold alerts between t1 and t2
+void entryRange(struct sortedIndex *index, int sensor, int64_t t1, int64_t t2, int64_t *first, int64_t *last){
+    *first = 0;
+    *last = 0;
+    if (sensor < 0 || sensor >= index->numSensors)
+        return;
+    *first = storeFirstEntryAfter(index->maxTimeSoFar, index->start[sensor], index->start[sensor+1], t1);
+    *last = storeFirstEntryStartingAfter(index->entries, *first, index->start[sensor+1], t2);
+}
+
+//Pointer to the column of the block described by the index entry
+const void *blockColumn(struct mappedFile *dataFile, struct storeIndexEntry *entry, int column){
+    return dataFile->data + entry->offset + storeColumnOffset(column, entry->numRecords);
+}
+
+//Count the true and false alerts of the sensor between t1 and t2. Blocks fully inside the range
+//are answered from the index, only the blocks on the edges of the range are read.
+void countAlerts(struct mappedFile *dataFile, struct sortedIndex *index, int sensor, int64_t t1, int64_t t2, long *trueCount, long *falseCount){
+    int64_t first, last;
+    *trueCount = 0;
+    *falseCount = 0;
+    entryRange(index, sensor, t1, t2, &first, &last);
+    for (int64_t b = first; b < last; b++){
+        struct storeIndexEntry *entry = &index->entries[b];
+        if (entry->maxTime < t1)
+            continue;
+
+        if (entry->minTime >= t1 && entry->maxTime <= t2){
+            *trueCount += entry->trueCount;
+            *falseCount += entry->falseCount;
+            continue;
+        }
+
+        const int64_t *times = blockColumn(dataFile, entry, STORE_COL_SENSOR_TIME);
+        const int8_t *types = blockColumn(dataFile, entry, STORE_COL_ALERT_TYPE);
+        for (int i = 0; i < entry->numRecords; i++){
+            if (times[i] < t1 || times[i] > t2)
+                continue;
+            if (types[i] == ALERT_TRUE)
+                *trueCount += 1;
+            else
+                *falseCount += 1;
+        }
+    }
+}
+
+//Print every alert of the sensor between t1 and t2
+void dumpAlerts(struct mappedFile *dataFile, struct sortedIndex *index, int sensor, int64_t t1, int64_t t2){
+    int64_t first, last;
+    entryRange(index, sensor, t1, t2, &first, &last);
+    printf("SensorTime\tCoord\t\tHeight(m)\tSatHeight(m)\tType\t\tMsgs\tMatches\n");
+    for (int64_t b = first; b < last; b++){
+        struct storeIndexEntry *entry = &index->entries[b];
+        if (entry->maxTime < t1)
+            continue;
+
+        const int64_t *times = blockColumn(dataFile, entry, STORE_COL_SENSOR_TIME);
+        const float *heights = blockColumn(dataFile, entry, STORE_COL_SENSOR_HEIGHT);
+        const float *satHeights = blockColumn(dataFile, entry, STORE_COL_SAT_HEIGHT);
+        const int32_t *coord1 = blockColumn(dataFile, entry, STORE_COL_COORD1);
+        const int32_t *coord2 = blockColumn(dataFile, entry, STORE_COL_COORD2);
+        const int32_t *numMsgs = blockColumn(dataFile, entry, STORE_COL_NUM_MSGS);
+        const int32_t *similar = blockColumn(dataFile, entry, STORE_COL_SIMILAR);
+        const int8_t *types = blockColumn(dataFile, entry, STORE_COL_ALERT_TYPE);
+        for (int i = 0; i < entry->numRecords; i++){
+            if (times[i] < t1 || times[i] > t2)
+                continue;
+            const char *typeName = types[i] == ALERT_TRUE ? "True" : (types[i] == ALERT_FALSE ? "False" : "NoSatellite");
+            printf("%lld\t(%d, %d)\t\t%.3f\t%.3f\t%-11s\t%d\t%d\n", (long long)times[i], coord1[i], coord2[i], heights[i], satHeights[i], typeName, numMsgs[i], similar[i]);
+        }
+    }
+}
+
+//Print the alert counts of every sensor from the index only
+void summary(struct sortedIndex *index){
+    printf("Reporting Node\t\tTrue alerts\t\tFalse alerts\t\tFalse alert rate\n");
+    for (int s = 0; s < index->numSensors; s++){
+        long trueCount = 0, falseCount = 0;
+        for (int64_t b = index->start[s]; b < index->start[s+1]; b++){
+            trueCount += index->entries[b].trueCount;
+            falseCount += index->entries[b].falseCount;
+        }
+        long total = trueCount + falseCount;
+        printf("%d\t\t\t\t\t%ld\t\t\t\t%ld\t\t\t\t%.3f\n", s, trueCount, falseCount, total > 0 ? (double)falseCount / total : 0.0);
+    }
+}
+
+int main(int argc, char *argv[]){
+    struct mappedFile dataFile, indexFile, sortedFile;
+    struct sortedIndex index;
+    char indexPath[512];
+    struct timespec start, end;
+
+    if (argc < 3 || ((strcmp(argv[2], "rate") == 0 || strcmp(argv[2], "dump") == 0) && argc != 6)){
+        printf("Usage: %s <store> summary\n", argv[0]);
+        printf("       %s <store> rate <sensor> <t1> <t2>\n", argv[0]);
+        printf("       %s <store> dump <sensor> <t1> <t2>\n", argv[0]);
+        return 1;
+    }
+
+    snprintf(indexPath, sizeof(indexPath), "%s%s", argv[1], STORE_INDEX_SUFFIX);
+    if (mapFile(argv[1], &dataFile) != 0 || mapFile(indexPath, &indexFile) != 0){
+        printf("ERROR: can not open the store %s\n", argv[1]);
+        return 1;
+    }
+
+    struct storeHeader *header = (struct storeHeader*)dataFile.data;
+    if (dataFile.size < sizeof(struct storeHeader) || memcmp(header->magic, STORE_MAGIC, 8) != 0 || header->version != STORE_VERSION){
+        printf("ERROR: %s is not an alert store\n", argv[1]);
+        return 1;
+    }
+
+    if (loadIndex(argv[1], header, &indexFile, &sortedFile, &index) != 0){
+        printf("ERROR: can not read the index of %s\n", argv[1]);
+        return 1;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    if (strcmp(argv[2], "summary") == 0){
+        summary(&index);
+    }
+    else if (strcmp(argv[2], "rate") == 0){
+        long trueCount, falseCount;
+        int sensor = atoi(argv[3]);
+        int64_t t1 = atoll(argv[4]);
+        int64_t t2 = atoll(argv[5]);
+        countAlerts(&dataFile, &index, sensor, t1, t2, &trueCount, &falseCount);
+
+        long total = trueCount + falseCount;
+        printf("Sensor %d between %lld and %lld: %ld true alerts, %ld false alerts\n", sensor, (long long)t1, (long long)t2, trueCount, falseCount);
+        printf("False alert rate: %.3f\n", total > 0 ? (double)falseCount / total : 0.0);
+    }
+    else if (strcmp(argv[2], "dump") == 0){
+        dumpAlerts(&dataFile, &index, atoi(argv[3]), atoll(argv[4]), atoll(argv[5]));
+    }
+    else {
+        printf("ERROR: unknown query %s\n", argv[2]);
+        return 1;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    printf("Query time (ms): %.3f\n", (end.tv_sec - start.tv_sec) * 1000.0 + (end.tv_nsec - start.tv_nsec) / 1e6);
+
+    if (dataFile.data != NULL)
+        munmap(dataFile.data, dataFile.size);
+    if (indexFile.data != NULL)
+        munmap(indexFile.data, indexFile.size);
+    if (sortedFile.data != NULL)
+        munmap(sortedFile.data, sortedFile.size);
+    if (index.allocated == 1){
+        free(index.entries);
+        free(index.start);
+        free(index.maxTimeSoFar);
+    }
+    return 0;
+}
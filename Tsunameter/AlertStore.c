@@ -0,0 +1,311 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include "AlertStore.h"
+
+int storeColumnWidth(int column){
+    if (column <= STORE_COL_SAT_TIME)
+        return sizeof(int64_t);
+    if (column == STORE_COL_ALERT_TYPE)
+        return sizeof(int8_t);
+    return 4; //float and int32 columns
+}
+
+int64_t storeColumnOffset(int column, int numRecords){
+    int64_t offset = 0;
+    for (int c = 0; c < column; c++)
+        offset += (int64_t)storeColumnWidth(c) * numRecords;
+    return offset;
+}
+
+static int compareIndexEntry(const void *a, const void *b){
+    const struct storeIndexEntry *x = (const struct storeIndexEntry*)a;
+    const struct storeIndexEntry *y = (const struct storeIndexEntry*)b;
+    if (x->sensorRank != y->sensorRank)
+        return (x->sensorRank > y->sensorRank) - (x->sensorRank < y->sensorRank);
+    if (x->minTime != y->minTime)
+        return (x->minTime > y->minTime) - (x->minTime < y->minTime);
+    return (x->offset > y->offset) - (x->offset < y->offset);
+}
+
+void storeSortIndex(struct storeIndexEntry *entries, int64_t numEntries, int numSensors, int64_t *start, int64_t *maxTimeSoFar){
+    //Entries of unknown sensors sort after every sensor
+    for (int64_t i = 0; i < numEntries; i++){
+        if (entries[i].sensorRank < 0 || entries[i].sensorRank >= numSensors)
+            entries[i].sensorRank = numSensors;
+    }
+    qsort(entries, numEntries, sizeof(struct storeIndexEntry), compareIndexEntry);
+
+    int64_t i = 0;
+    for (int s = 0; s <= numSensors; s++){
+        start[s] = i;
+        if (s == numSensors)
+            break;
+        int64_t maxTime = INT64_MIN;
+        for (; i < numEntries && entries[i].sensorRank == s; i++){
+            if (entries[i].maxTime > maxTime)
+                maxTime = entries[i].maxTime;
+            maxTimeSoFar[i] = maxTime;
+        }
+    }
+    for (; i < numEntries; i++)
+        maxTimeSoFar[i] = entries[i].maxTime;
+}
+
+int64_t storeFirstEntryAfter(const int64_t *maxTimeSoFar, int64_t first, int64_t last, int64_t t1){
+    while (first < last){
+        int64_t middle = first + (last - first) / 2;
+        if (maxTimeSoFar[middle] < t1)
+            first = middle + 1;
+        else
+            last = middle;
+    }
+    return first;
+}
+
+int64_t storeFirstEntryStartingAfter(const struct storeIndexEntry *entries, int64_t first, int64_t last, int64_t t2){
+    while (first < last){
+        int64_t middle = first + (last - first) / 2;
+        if (entries[middle].minTime <= t2)
+            first = middle + 1;
+        else
+            last = middle;
+    }
+    return first;
+}
+
+//Write the index sorted by sensor and time next to the store, from the index file written so far.
+//Written to a temporary file and renamed, so a query never sees half of it
+static void writeSortedIndex(struct alertStore *store){
+    char indexPath[sizeof(store->path) + 8], sortedPath[sizeof(store->path) + 8], tmpPath[sizeof(store->path) + 16];
+    snprintf(indexPath, sizeof(indexPath), "%s%s", store->path, STORE_INDEX_SUFFIX);
+    snprintf(sortedPath, sizeof(sortedPath), "%s%s", store->path, STORE_SORTED_SUFFIX);
+    snprintf(tmpPath, sizeof(tmpPath), "%s.tmp", sortedPath);
+
+    FILE *indexFile = fopen(indexPath, "rb");
+    if (indexFile == NULL)
+        return;
+    fseek(indexFile, 0, SEEK_END);
+    int64_t numEntries = ftell(indexFile) / sizeof(struct storeIndexEntry);
+    fseek(indexFile, 0, SEEK_SET);
+
+    struct storeIndexEntry *entries = (struct storeIndexEntry*)malloc((numEntries > 0 ? numEntries : 1) * sizeof(struct storeIndexEntry));
+    int64_t *start = (int64_t*)malloc((store->numSensors + 1) * sizeof(int64_t));
+    int64_t *maxTimeSoFar = (int64_t*)malloc((numEntries > 0 ? numEntries : 1) * sizeof(int64_t));
+    int ok = entries != NULL && start != NULL && maxTimeSoFar != NULL && fread(entries, sizeof(struct storeIndexEntry), numEntries, indexFile) == (size_t)numEntries;
+    fclose(indexFile);
+
+    FILE *sortedFile = ok ? fopen(tmpPath, "wb") : NULL;
+    if (sortedFile != NULL){
+        storeSortIndex(entries, numEntries, store->numSensors, start, maxTimeSoFar);
+
+        struct storeSortedHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, STORE_SORTED_MAGIC, 8);
+        header.version = STORE_VERSION;
+        header.numSensors = store->numSensors;
+        header.numEntries = numEntries;
+        fwrite(&header, sizeof(header), 1, sortedFile);
+        fwrite(start, sizeof(int64_t), store->numSensors + 1, sortedFile);
+        fwrite(entries, sizeof(struct storeIndexEntry), numEntries, sortedFile);
+        fwrite(maxTimeSoFar, sizeof(int64_t), numEntries, sortedFile);
+        if (fclose(sortedFile) == 0)
+            rename(tmpPath, sortedPath);
+    }
+    free(entries);
+    free(start);
+    free(maxTimeSoFar);
+}
+
+//The sorted index of an earlier run no longer matches once the store is written again
+static void removeSortedIndex(struct alertStore *store){
+    char sortedPath[sizeof(store->path) + 8];
+    snprintf(sortedPath, sizeof(sortedPath), "%s%s", store->path, STORE_SORTED_SUFFIX);
+    remove(sortedPath);
+}
+
+int alertStoreOpen(struct alertStore *store, const char *path, int numSensors){
+    char indexPath[sizeof(store->path) + 8];
+    if (strlen(path) >= sizeof(store->path))
+        return -1;
+    snprintf(store->path, sizeof(store->path), "%s", path);
+    snprintf(indexPath, sizeof(indexPath), "%s%s", store->path, STORE_INDEX_SUFFIX);
+    removeSortedIndex(store);
+
+    store->dataFile = fopen(store->path, "wb");
+    store->indexFile = fopen(indexPath, "wb");
+    if (store->dataFile == NULL || store->indexFile == NULL){
+        if (store->dataFile != NULL)
+            fclose(store->dataFile);
+        if (store->indexFile != NULL)
+            fclose(store->indexFile);
+        return -1;
+    }
+
+    struct storeHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, STORE_MAGIC, 8);
+    header.version = STORE_VERSION;
+    header.blockRecords = STORE_BLOCK_RECORDS;
+    header.numSensors = numSensors;
+    fwrite(&header, sizeof(header), 1, store->dataFile);
+
+    store->numSensors = numSensors;
+    store->offset = sizeof(header);
+    store->bufferCount = (int*)calloc(numSensors, sizeof(int));
+    store->buffer = (struct alertRecord*)malloc((size_t)numSensors * STORE_BLOCK_RECORDS * sizeof(struct alertRecord));
+    return 0;
+}
+
+int alertStoreResume(struct alertStore *store, const char *path, int numSensors, int64_t dataSize, int64_t indexSize){
+    char indexPath[sizeof(store->path) + 8];
+    if (strlen(path) >= sizeof(store->path))
+        return -1;
+    snprintf(store->path, sizeof(store->path), "%s", path);
+    snprintf(indexPath, sizeof(indexPath), "%s%s", store->path, STORE_INDEX_SUFFIX);
+    removeSortedIndex(store);
+
+    store->dataFile = fopen(store->path, "r+b");
+    store->indexFile = fopen(indexPath, "r+b");
+    if (store->dataFile == NULL || store->indexFile == NULL){
+        if (store->dataFile != NULL)
+            fclose(store->dataFile);
+        if (store->indexFile != NULL)
+            fclose(store->indexFile);
+        return -1;
+    }
+
+    //Check the header matches before cutting anything
+    struct storeHeader header;
+    if (fread(&header, sizeof(header), 1, store->dataFile) != 1 || memcmp(header.magic, STORE_MAGIC, 8) != 0 || header.numSensors != numSensors
+        || dataSize < (int64_t)sizeof(header) || ftruncate(fileno(store->dataFile), dataSize) != 0 || ftruncate(fileno(store->indexFile), indexSize) != 0){
+        fclose(store->dataFile);
+        fclose(store->indexFile);
+        return -1;
+    }
+    fseek(store->dataFile, 0, SEEK_END);
+    fseek(store->indexFile, 0, SEEK_END);
+
+    store->numSensors = numSensors;
+    store->offset = dataSize;
+    store->bufferCount = (int*)calloc(numSensors, sizeof(int));
+    store->buffer = (struct alertRecord*)malloc((size_t)numSensors * STORE_BLOCK_RECORDS * sizeof(struct alertRecord));
+    return 0;
+}
+
+//Write the buffered alerts of the sensor as one block, column by column, and add it to the index
+static void writeBlock(struct alertStore *store, int sensor){
+    int count = store->bufferCount[sensor];
+    struct alertRecord *records = &store->buffer[(size_t)sensor * STORE_BLOCK_RECORDS];
+    struct storeIndexEntry entry;
+
+    if (count == 0)
+        return;
+
+    memset(&entry, 0, sizeof(entry));
+    entry.sensorRank = sensor;
+    entry.numRecords = count;
+    entry.offset = store->offset;
+    entry.minTime = (int64_t)records[0].sensorTime;
+    entry.maxTime = (int64_t)records[0].sensorTime;
+
+    //One column at a time, reusing a buffer large enough for the widest column
+    int64_t column64[STORE_BLOCK_RECORDS];
+    int32_t *column32 = (int32_t*)column64;
+    float *columnFloat = (float*)column64;
+    int8_t *column8 = (int8_t*)column64;
+
+    for (int c = 0; c < STORE_NUM_COLS; c++){
+        for (int i = 0; i < count; i++){
+            switch (c){
+                case STORE_COL_SENSOR_TIME: column64[i] = (int64_t)records[i].sensorTime; break;
+                case STORE_COL_LOG_TIME: column64[i] = (int64_t)records[i].logTime; break;
+                case STORE_COL_SAT_TIME: column64[i] = (int64_t)records[i].satTime; break;
+                case STORE_COL_SENSOR_HEIGHT: columnFloat[i] = records[i].sensorHeight; break;
+                case STORE_COL_SAT_HEIGHT: columnFloat[i] = records[i].satHeight; break;
+                case STORE_COL_RANK: column32[i] = records[i].sensorRank; break;
+                case STORE_COL_COORD1: column32[i] = records[i].sensorCoord1; break;
+                case STORE_COL_COORD2: column32[i] = records[i].sensorCoord2; break;
+                case STORE_COL_SAT_COORD1: column32[i] = records[i].satCoord1; break;
+                case STORE_COL_SAT_COORD2: column32[i] = records[i].satCoord2; break;
+                case STORE_COL_NUM_MSGS: column32[i] = records[i].numMsgs; break;
+                case STORE_COL_SIMILAR: column32[i] = records[i].similarCount; break;
+                case STORE_COL_ALERT_TYPE: column8[i] = (int8_t)records[i].alertType; break;
+            }
+        }
+        fwrite(column64, storeColumnWidth(c), count, store->dataFile);
+    }
+
+    for (int i = 0; i < count; i++){
+        int64_t thisTime = (int64_t)records[i].sensorTime;
+        if (thisTime < entry.minTime)
+            entry.minTime = thisTime;
+        if (thisTime > entry.maxTime)
+            entry.maxTime = thisTime;
+        if (records[i].alertType == ALERT_TRUE)
+            entry.trueCount += 1;
+        else
+            entry.falseCount += 1;
+    }
+
+    //Write the block before the index entry, so the index never points past the data
+    fflush(store->dataFile);
+    fwrite(&entry, sizeof(entry), 1, store->indexFile);
+    fflush(store->indexFile);
+
+    store->offset += storeColumnOffset(STORE_NUM_COLS, count);
+    store->bufferCount[sensor] = 0;
+
+    //Pad to 8 bytes so the int64 columns of the next block are aligned when memory mapped
+    int64_t padding = (8 - store->offset % 8) % 8;
+    for (int64_t i = 0; i < padding; i++)
+        fputc(0, store->dataFile);
+    store->offset += padding;
+}
+
+void alertStoreAppend(struct alertStore *store, struct alertRecord *record){
+    int sensor = record->sensorRank;
+    if (sensor < 0 || sensor >= store->numSensors)
+        return;
+
+    store->buffer[(size_t)sensor * STORE_BLOCK_RECORDS + store->bufferCount[sensor]] = *record;
+    store->bufferCount[sensor] += 1;
+
+    if (store->bufferCount[sensor] == STORE_BLOCK_RECORDS)
+        writeBlock(store, sensor);
+}
+
+int64_t alertStoreFlush(struct alertStore *store){
+    fflush(store->dataFile);
+    fflush(store->indexFile);
+    return (int64_t)ftell(store->indexFile);
+}
+
+int alertStoreBuffered(struct alertStore *store){
+    int count = 0;
+    for (int s = 0; s < store->numSensors; s++)
+        count += store->bufferCount[s];
+    return count;
+}
+
+void alertStoreCopyBuffered(struct alertStore *store, struct alertRecord *records){
+    for (int s = 0; s < store->numSensors; s++){
+        memcpy(records, &store->buffer[(size_t)s * STORE_BLOCK_RECORDS], store->bufferCount[s] * sizeof(struct alertRecord));
+        records += store->bufferCount[s];
+    }
+}
+
+void alertStoreClose(struct alertStore *store){
+    for (int s = 0; s < store->numSensors; s++)
+        writeBlock(store, s);
+
+    fclose(store->dataFile);
+    fclose(store->indexFile);
+    free(store->bufferCount);
+    free(store->buffer);
+
+    writeSortedIndex(store);
+}
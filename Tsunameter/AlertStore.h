@@ -0,0 +1,174 @@
+#ifndef ALERTSTORE_H
+#define ALERTSTORE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+
+//Columnar on-disk store of the alerts classified by the base station.
+//
+//The data file starts with a header, followed by blocks. Every block holds up to STORE_BLOCK_RECORDS
+//alerts of a single sensor, stored column by column (all sensor times, then all log times, ...), so a
+//query only reads the columns it needs. Every block written also appends one entry to the index file,
+//with the sensor, the time range and the true/false counts of the block. Both files are only appended
+//to, so a crash keeps every block written before it.
+//
+//When the store is closed the index is also written sorted, grouped by sensor and ordered by time, with
+//the first entry of every sensor (STORE_SORTED_SUFFIX). A query then binary searches the blocks of its
+//sensor and time range instead of reading the whole index.
+
+#define STORE_MAGIC "TSUNSTOR"
+#define STORE_VERSION 1
+#define STORE_BLOCK_RECORDS 1024
+#define STORE_INDEX_SUFFIX ".idx"
+#define STORE_SORTED_SUFFIX ".sidx"
+#define STORE_SORTED_MAGIC "TSUNSIDX"
+
+//Classification of an alert
+#define ALERT_FALSE 0          //satellite reading found but the heights do not match
+#define ALERT_TRUE 1           //satellite reading found and the heights match
+#define ALERT_NO_SATELLITE 2   //no satellite reading for the location and time, counted as false
+
+//One alert as classified by the base station
+struct alertRecord{
+    int sensorRank;
+    int sensorCoord1;
+    int sensorCoord2;
+    int satCoord1;
+    int satCoord2;
+    float sensorHeight;
+    float satHeight;
+    time_t sensorTime;
+    time_t satTime;
+    time_t logTime;
+    int alertType;
+    int numMsgs;
+    int similarCount;
+};
+
+//Header at the start of the data file
+struct storeHeader{
+    char magic[8];
+    int32_t version;
+    int32_t blockRecords;
+    int32_t numSensors;
+    int32_t reserved;
+};
+
+//Entry in the index file for every block
+struct storeIndexEntry{
+    int32_t sensorRank;
+    int32_t numRecords;
+    int64_t minTime;      //smallest sensor time in the block
+    int64_t maxTime;      //largest sensor time in the block
+    int64_t offset;       //offset of the block in the data file
+    int32_t trueCount;
+    int32_t falseCount;   //includes the alerts without a satellite reading
+};
+
+//Header of the sorted index. It is followed by numSensors+1 int64 with the first entry of every sensor
+//(the entries of sensor s are [start[s], start[s+1])), the sorted entries, and for every entry the
+//largest maxTime of the sensor's entries up to it, so the first block ending after a time can be binary searched.
+struct storeSortedHeader{
+    char magic[8];
+    int32_t version;
+    int32_t numSensors;
+    int64_t numEntries;   //must match the number of entries in the index file
+};
+
+//The columns of a block, in the order they are written
+#define STORE_COL_SENSOR_TIME 0    //int64
+#define STORE_COL_LOG_TIME 1       //int64
+#define STORE_COL_SAT_TIME 2       //int64
+#define STORE_COL_SENSOR_HEIGHT 3  //float
+#define STORE_COL_SAT_HEIGHT 4     //float
+#define STORE_COL_RANK 5           //int32
+#define STORE_COL_COORD1 6         //int32
+#define STORE_COL_COORD2 7         //int32
+#define STORE_COL_SAT_COORD1 8     //int32
+#define STORE_COL_SAT_COORD2 9     //int32
+#define STORE_COL_NUM_MSGS 10      //int32
+#define STORE_COL_SIMILAR 11       //int32
+#define STORE_COL_ALERT_TYPE 12    //int8
+#define STORE_NUM_COLS 13
+
+//Writer used by the base station. Alerts are buffered per sensor until a block is full
+struct alertStore{
+    char path[512];          //path of the data file, the other files add their suffix to it
+    FILE *dataFile;
+    FILE *indexFile;
+    int numSensors;
+    int64_t offset;                 //where the next block is written in the data file
+    int *bufferCount;               //number of buffered alerts of every sensor
+    struct alertRecord *buffer;     //STORE_BLOCK_RECORDS alerts for every sensor
+};
+
+/**
+* Width in bytes of one value of the column.
+**/
+int storeColumnWidth(int column);
+
+/**
+* Offset of the column inside a block of numRecords alerts, from the start of the block.
+**/
+int64_t storeColumnOffset(int column, int numRecords);
+
+/**
+* Sort the index entries by sensor then minTime, and fill start (numSensors+1 entries, the first entry of
+* every sensor) and maxTimeSoFar (numEntries, the running largest maxTime within every sensor).
+* Entries of sensors outside [0, numSensors) are moved to the end and not part of any sensor.
+**/
+void storeSortIndex(struct storeIndexEntry *entries, int64_t numEntries, int numSensors, int64_t *start, int64_t *maxTimeSoFar);
+
+/**
+* Index of the first of the sensor's entries in [first, last) that may hold alerts at or after t1,
+* from its maxTimeSoFar. Binary search.
+**/
+int64_t storeFirstEntryAfter(const int64_t *maxTimeSoFar, int64_t first, int64_t last, int64_t t1);
+
+/**
+* Index of the first of the sensor's sorted entries in [first, last) which starts after t2. Binary search.
+**/
+int64_t storeFirstEntryStartingAfter(const struct storeIndexEntry *entries, int64_t first, int64_t last, int64_t t2);
+
+/**
+* Create the data file at path and the index file next to it. Returns 0 on success, -1 on error
+* (including a path longer than the path field of the store).
+**/
+int alertStoreOpen(struct alertStore *store, const char *path, int numSensors);
+
+/**
+* Reopen a store to continue writing it after a restart. The files are cut back to dataSize and indexSize
+* bytes (the sizes after the last alertStoreFlush), dropping the blocks written after it. Returns 0 on success, -1 on error.
+**/
+int alertStoreResume(struct alertStore *store, const char *path, int numSensors, int64_t dataSize, int64_t indexSize);
+
+/**
+* Add an alert to the store. The block of the sensor is written when full.
+**/
+void alertStoreAppend(struct alertStore *store, struct alertRecord *record);
+
+/**
+* Flush the files, so every full block written so far is on disk. The alerts of the blocks which are not
+* full stay buffered (see alertStoreBuffered). Returns the size of the index file in bytes. The size of the
+* data file is store->offset.
+**/
+int64_t alertStoreFlush(struct alertStore *store);
+
+/**
+* Number of buffered alerts, not written in a block yet.
+**/
+int alertStoreBuffered(struct alertStore *store);
+
+/**
+* Copy the buffered alerts to records (alertStoreBuffered entries), sensor by sensor. Appending them to a
+* resumed store restores its buffers.
+**/
+void alertStoreCopyBuffered(struct alertStore *store, struct alertRecord *records);
+
+/**
+* Write the blocks which are not full, close the files and write the sorted index.
+**/
+void alertStoreClose(struct alertStore *store);
+
+#endif
@@ -5,13 +5,18 @@
 #include <unistd.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <pthread.h>
 #include "BaseStationSubroutine.h"
 #include "HelperFunctions.h"
+#include "AlertStore.h"
+#include "Checkpoint.h"
+#include "SensorStats.h"
 
 
 #define NUM_THREADS 2
 #define SATELITE_SIZE 100
+#define STORE_PATH "alerts.store"   //columnar alert store, read with the alertquery tool
 
 // thread mutex and cond vars etc
 pthread_mutex_t g_Mutex = PTHREAD_MUTEX_INITIALIZER;
@@ -47,25 +52,29 @@ struct satVal{
     time_t satTime;
 };
 
-//Alert from sensors
-struct alert{
-    int sensorRank;
-    int sensor_coord1;
-    int sensor_coord2;
-    float sensorHeight;
-    int neighRank[4];
-    int neigh_coord1[4];
-    int neigh_coord2[4];
-    float neighHeight[4];
-    int similarCount;
-    time_t sensorTime;
-    int numMsgs;
-};
-
 struct satVal satReadings[SATELITE_SIZE]; //global array which is populated with satellite readings
 int satReadCount = 0;
 double totalCommTime = 0.0;   //total communication time for base station and sensors throughout program
 
+//State of the base station in the checkpoint, after the header. Followed by the per sensor counts
+//(true alerts, false alerts, events, times degraded), numSensors ints each, and the buffered alerts of the store. The degraded reports are not
+//kept: after a restart every sensor starts with its neighbours alive, so nothing would report the recovery
+struct baseCheckpoint{
+    int32_t baseIterCount;
+    int32_t totalMsgCount;
+    int32_t nextIndex;
+    int32_t satReadCount;
+    int32_t checkpointCount;
+    double totalCommTime;
+    double checkpointTime;        //seconds spent writing the earlier checkpoints
+    double lastCheckpointTime;    //seconds spent writing this checkpoint, added to the file by checkpointWrite once known
+    int64_t storeDataSize;        //size of the alert store files when the checkpoint was written
+    int64_t storeIndexSize;
+    int32_t storeTailRecords;     //buffered alerts of the store, not in a block yet. Written after the counts
+    struct satVal satReadings[SATELITE_SIZE];
+};
+#define BASE_CHECKPOINT_COUNTS 4
+
 // satelite t function
 void *sateliteAltimeter(void *pArg) {
     // while not terminated, get next index, generate new reading, coord and time
@@ -101,7 +110,7 @@ void *sateliteAltimeter(void *pArg) {
 
 
 //Function to log info to file
-void writeToLog(int iteration, int senRank, int senC1, int senC2, int satC1, int satC2, time_t senTime, time_t satTime, float senHeight, float satHeight, int neiMatchCount, int neiRank[], int neiC1[], int neiC2[], float neiHeight[], int alertType, int neiMsgs) {
+void writeToLog(int iteration, int senRank, int senC1, int senC2, float senLat, float senLon, int satC1, int satC2, time_t senTime, time_t satTime, float senHeight, float satHeight, int neiMatchCount, int neiCount, int neiRank[], int neiC1[], int neiC2[], float neiHeight[], int alertType, int neiMsgs, int alertPhase, int eventCycles, float peakHeight) {
     double sensorBaseCommTime;
     time_t nowTime;
     nowTime = time(NULL);
@@ -120,15 +129,18 @@ void writeToLog(int iteration, int senRank, int senC1, int senC2, int satC1, int
         fprintf(file, "Alert type: True\n");
     else
         fprintf(file, "Alert type: False\n");
+    if (alertPhase == ALERT_PHASE_RAISED)
+        fprintf(file, "Alert phase: Raised\n");
+    else
+        fprintf(file, "Alert phase: Ongoing (summary after %d cycles, peak height (m): %.3f)\n", eventCycles, peakHeight);
 
     // fprintf(file, "\nReporting Node\t\tCoord\t\tHeight(m)\t\tIPv4\n");
-    fprintf(file, "\nReporting Node\t\tCoord\t\tHeight(m)\n");
-    fprintf(file, "%d\t\t\t\t\t(%d, %d)\t\t%.3f\n", senRank, senC1, senC2, senHeight);
+    fprintf(file, "\nReporting Node\t\tCoord\t\tHeight(m)\t\tLat/Lon\n");
+    fprintf(file, "%d\t\t\t\t\t(%d, %d)\t\t%.3f\t\t(%.4f, %.4f)\n", senRank, senC1, senC2, senHeight, senLat, senLon);
 
     fprintf(file, "\nAdjacent Nodes\t\tCoord\t\tHeight(m)\n");
-    for (int i=0; i<4; i++) {
-        if (neiRank[i] != -2)
-            fprintf(file,"%d\t\t\t\t\t(%d, %d)\t\t%.3f\n", neiRank[i], neiC1[i], neiC2[i], neiHeight[i]);
+    for (int i=0; i<neiCount; i++) {
+        fprintf(file,"%d\t\t\t\t\t(%d, %d)\t\t%.3f\n", neiRank[i], neiC1[i], neiC2[i], neiHeight[i]);
     }
 
     if (satC1 != -1) {
@@ -147,7 +159,210 @@ void writeToLog(int iteration, int senRank, int senC1, int senC2, int satC1, int
     fclose(file); 
 }
 
-void baseStationSubroutine(float waterThreshold, float maxWaterHeight, int nbaseIters, int nrows, int ncols, MPI_Comm commWorld, int sendAlertBaseTag, int sendTerminationTag, int numSensors, float heightTolerance, float timeTolerance){
+//Function to log the end of an event, when the sensor's average dropped below the disarm threshold
+void writeClearedToLog(int iteration, int senRank, int senC1, int senC2, time_t senTime, float senHeight, int eventCycles, float peakHeight) {
+    time_t nowTime;
+    nowTime = time(NULL);
+
+    FILE* file = fopen("logs.txt", "a");
+    fprintf(file, "=====================    EVENT CLEARED    =====================\n");
+    fprintf(file, "Iteration: %d\n", iteration);
+    fprintf(file, "Logged time: %s", ctime(&nowTime));
+    fprintf(file, "Cleared time: %s", ctime(&senTime));
+    fprintf(file, "Sensor %d at (%d, %d) cleared its event after %d cycles\n", senRank, senC1, senC2, eventCycles);
+    fprintf(file, "Peak height (m): %.3f. Height when cleared (m): %.3f\n", peakHeight, senHeight);
+    fprintf(file, "===============================================================\n");
+    fclose(file); 
+}
+
+//Function to log the cost of a checkpoint
+void writeCheckpointToLog(int iteration, int epoch, double seconds, long bytes) {
+    time_t nowTime;
+    nowTime = time(NULL);
+
+    FILE* file = fopen("logs.txt", "a");
+    fprintf(file, "=====================    CHECKPOINT    =====================\n");
+    fprintf(file, "Iteration: %d\n", iteration);
+    fprintf(file, "Logged time: %s", ctime(&nowTime));
+    if (seconds < 0)
+        fprintf(file, "Checkpoint %d could not be written to %s. The previous checkpoint is kept\n", epoch, CHECKPOINT_PATH);
+    else
+        fprintf(file, "Checkpoint %d written to %s: %ld bytes in %.4f seconds\n", epoch, CHECKPOINT_PATH, bytes, seconds);
+    fprintf(file, "============================================================\n");
+    fclose(file); 
+}
+
+//Function to log a sensor becoming noisy or recovering
+void writeNoisyToLog(int iteration, int senRank, struct sensorStats *stats) {
+    time_t nowTime;
+    nowTime = time(NULL);
+
+    FILE* file = fopen("logs.txt", "a");
+    fprintf(file, "=====================    NOISY SENSOR    =====================\n");
+    fprintf(file, "Iteration: %d\n", iteration);
+    fprintf(file, "Logged time: %s", ctime(&nowTime));
+    if (stats->noisy[senRank])
+        fprintf(file, "Sensor %d is flagged as noisy\n", senRank);
+    else
+        fprintf(file, "Sensor %d is no longer noisy\n", senRank);
+    fprintf(file, "Height error EWMA (m): %.3f. Recent checked alerts: %.1f, of which true: %.1f\n", stats->errorEwma[senRank], stats->decayedChecked[senRank], stats->decayedTrue[senRank]);
+    fprintf(file, "==============================================================\n");
+    fclose(file); 
+}
+
+//Function to log a snapshot of the streaming statistics of the sensors. The noisy flags are evaluated again first,
+//since a sensor which stopped alerting is only updated here
+void writeStatsToLog(int iteration, struct sensorStats *stats) {
+    time_t nowTime;
+    nowTime = time(NULL);
+
+    for (int i = 0; i < stats->numSensors; i++){
+        if (sensorStatsRefresh(stats, i, nowTime) == 1)
+            writeNoisyToLog(iteration, i, stats);
+    }
+
+    FILE* file = fopen("logs.txt", "a");
+    fprintf(file, "=====================    SENSOR STATISTICS    =====================\n");
+    fprintf(file, "Iteration: %d\n", iteration);
+    fprintf(file, "Logged time: %s", ctime(&nowTime));
+    fprintf(file, "Rates decayed with a half life of %.0f seconds\n\n", stats->halfLife);
+    sensorStatsWrite(stats, file, nowTime);
+    fprintf(file, "===================================================================\n");
+    fclose(file); 
+}
+
+//Function to log a change of a sensor's liveness reported by one of its neighbours
+void writeStatusToLog(int iteration, int reporterRank, int senRank, int degraded, int silentTime, int degradedReports) {
+    time_t nowTime;
+    nowTime = time(NULL);
+
+    FILE* file = fopen("logs.txt", "a");
+    fprintf(file, "=====================    SENSOR STATUS    =====================\n");
+    fprintf(file, "Iteration: %d\n", iteration);
+    fprintf(file, "Logged time: %s", ctime(&nowTime));
+    if (degraded == 1)
+        fprintf(file, "Sensor %d was not heard from in time by neighbour %d and is marked degraded (silent for %d seconds)\n", senRank, reporterRank, silentTime);
+    else
+        fprintf(file, "Sensor %d was heard from by neighbour %d again and has recovered (silent for %d seconds)\n", senRank, reporterRank, silentTime);
+    fprintf(file, "Number of neighbours reporting sensor %d as degraded: %d\n", senRank, degradedReports);
+    fprintf(file, "===============================================================\n");
+    fclose(file); 
+}
+
+//Receive the alert probed in alertStatus, compare it with the satellite readings, and log and count it
+static void receiveAlert(MPI_Status *alertStatus, MPI_Comm commWorld, int sendAlertBaseTag, int iteration, float heightTolerance, float timeTolerance, int *sensorTrueAlerts, int *sensorFalseAlerts, int *sensorEvents, int *totalMsgCount, struct alertStore *store, int storeOpen, struct sensorStats *stats, int statsOpen){
+    int alertType = 0;
+    struct alert sensorAlert;
+    struct satVal satReadMatch;
+    satReadMatch.sat_coord1 = -1;
+
+    //The alert size depends on the number of neighbours of the sensor
+    int alertSize;
+    MPI_Get_count(alertStatus, MPI_PACKED, &alertSize);
+    char *alertBuffer = (char*)malloc(alertSize > 0 ? alertSize : 1);
+    MPI_Recv(alertBuffer, alertSize, MPI_PACKED, alertStatus->MPI_SOURCE, sendAlertBaseTag, commWorld, MPI_STATUS_IGNORE);
+    unpackAlert(alertBuffer, alertSize, &sensorAlert, commWorld);
+    free(alertBuffer);
+    
+    //The end of an event is only logged, there is nothing to compare with the satellite
+    if (sensorAlert.alertPhase == ALERT_PHASE_CLEARED){
+        *totalMsgCount += sensorAlert.numMsgs;
+        writeClearedToLog(iteration, sensorAlert.sensorRank, sensorAlert.sensor_coord1, sensorAlert.sensor_coord2, sensorAlert.sensorTime, sensorAlert.sensorHeight, sensorAlert.eventCycles, sensorAlert.peakHeight);
+        freeAlert(&sensorAlert);
+        return;
+    }
+    if (sensorAlert.alertPhase == ALERT_PHASE_RAISED)
+        sensorEvents[sensorAlert.sensorRank] += 1;
+
+    *totalMsgCount += sensorAlert.numMsgs;
+    // satelite check
+    int satEnd = SATELITE_SIZE;
+    if (satReadCount < SATELITE_SIZE)
+        satEnd = satReadCount;
+    double closestTime = INFINITY;
+    //Only lock the readings. Waiting for the next satellite signal here held every alert up to a second,
+    //which is too slow once the sensors sample faster or several alerts arrive in one iteration
+    pthread_mutex_lock(&g_Mutex);
+    for (int j = 0; j < satEnd; j++) {
+    
+        //Check if coordinates matches
+        if (satReadings[j].sat_coord1 == sensorAlert.sensor_coord1 && satReadings[j].sat_coord2 == sensorAlert.sensor_coord2) {
+
+            //check if time matches between time threshold
+            double thisTime = difftime(sensorAlert.sensorTime, satReadings[j].satTime);
+            if (thisTime <= timeTolerance && thisTime < closestTime)
+                closestTime = thisTime;       
+                satReadMatch.sat_coord1 = satReadings[j].sat_coord1;
+                satReadMatch.sat_coord2 = satReadings[j].sat_coord2;
+                satReadMatch.satHeight = satReadings[j].satHeight;
+                satReadMatch.satTime = satReadings[j].satTime;
+        }
+    }
+    pthread_mutex_unlock(&g_Mutex);       
+
+    if (satReadMatch.sat_coord1 != -1) {
+        if ((abs(satReadMatch.satHeight-sensorAlert.sensorHeight)) <= heightTolerance) {
+            alertType = 1;    //If this is a true alert since matches the coordinates and satellite value water level
+            sensorTrueAlerts[sensorAlert.sensorRank] +=1;
+        } else    //If this is a false alert since matches the coordinates but not satellite value water level
+            sensorFalseAlerts[sensorAlert.sensorRank] +=1;
+    } else {
+        // no matching sat rec - set vals - still log record
+        satReadMatch.sat_coord1 = -1;
+        satReadMatch.sat_coord2 = -1;
+        satReadMatch.satHeight = 0.0;
+        satReadMatch.satTime = time(NULL);
+        sensorFalseAlerts[sensorAlert.sensorRank] +=1;
+        alertType = ALERT_NO_SATELLITE; //still a false alert, kept apart in the store
+    }
+    
+    //Update the statistics of the sensor
+    if (statsOpen == 1){
+        time_t nowTime = time(NULL);
+        float heightError = fabsf(satReadMatch.satHeight - sensorAlert.sensorHeight);
+        double latency = difftime(nowTime, sensorAlert.sensorTime);
+        if (sensorStatsUpdate(stats, sensorAlert.sensorRank, alertType, heightError, latency, nowTime) == 1)
+            writeNoisyToLog(iteration, sensorAlert.sensorRank, stats);
+    }
+
+    //Write the report into file
+    writeToLog(iteration, sensorAlert.sensorRank, sensorAlert.sensor_coord1, sensorAlert.sensor_coord2, sensorAlert.sensorLat, sensorAlert.sensorLon, satReadMatch.sat_coord1, satReadMatch.sat_coord2, sensorAlert.sensorTime, satReadMatch.satTime, sensorAlert.sensorHeight, satReadMatch.satHeight, sensorAlert.similarCount, sensorAlert.numNeighbours, sensorAlert.neighRank, sensorAlert.neigh_coord1, sensorAlert.neigh_coord2, sensorAlert.neighHeight, alertType == ALERT_TRUE, sensorAlert.numMsgs, sensorAlert.alertPhase, sensorAlert.eventCycles, sensorAlert.peakHeight);
+    
+    //Add the alert to the columnar store for the analysis after the run
+    if (storeOpen == 1){
+        struct alertRecord record;
+        record.sensorRank = sensorAlert.sensorRank;
+        record.sensorCoord1 = sensorAlert.sensor_coord1;
+        record.sensorCoord2 = sensorAlert.sensor_coord2;
+        record.satCoord1 = satReadMatch.sat_coord1;
+        record.satCoord2 = satReadMatch.sat_coord2;
+        record.sensorHeight = sensorAlert.sensorHeight;
+        record.satHeight = satReadMatch.satHeight;
+        record.sensorTime = sensorAlert.sensorTime;
+        record.satTime = satReadMatch.satTime;
+        record.logTime = time(NULL);
+        record.alertType = alertType;
+        record.numMsgs = sensorAlert.numMsgs;
+        record.similarCount = sensorAlert.similarCount;
+        alertStoreAppend(store, &record);
+    }
+    freeAlert(&sensorAlert);
+}
+
+//Receive a status change reported by a sensor and log it
+static void receiveStatus(int source, MPI_Comm commWorld, int sendStatusBaseTag, int iteration, int *sensorDegradedReports, int *sensorDegradedEvents){
+    int statusMsg[4]; //reporting sensor, sensor reported, degraded flag, seconds silent
+    MPI_Recv(statusMsg, 4, MPI_INT, source, sendStatusBaseTag, commWorld, MPI_STATUS_IGNORE);
+    if (statusMsg[2] == 1){
+        sensorDegradedReports[statusMsg[1]] += 1;
+        sensorDegradedEvents[statusMsg[1]] += 1;
+    }
+    else if (sensorDegradedReports[statusMsg[1]] > 0)
+        sensorDegradedReports[statusMsg[1]] -= 1;
+    writeStatusToLog(iteration, statusMsg[0], statusMsg[1], statusMsg[2], statusMsg[3], sensorDegradedReports[statusMsg[1]]);
+}
+
+void baseStationSubroutine(float waterThreshold, float maxWaterHeight, int nbaseIters, int nrows, int ncols, MPI_Comm commWorld, int sendAlertBaseTag, int sendTerminationTag, int sendStatusBaseTag, int numSensors, float heightTolerance, float timeTolerance, int sendCheckpointTag, int checkpointInterval, int restart, double statsHalfLife, int statsSnapshotInterval){
 
     //declare and init local variables
     int baseIterCount = 0;
@@ -158,8 +373,85 @@ void baseStationSubroutine(float waterThreshold, float maxWaterHeight, int nbase
     int* alertSensorFlags; //alert if sensor sends an alert
     int world_size; 
     MPI_Comm_size(commWorld, &world_size);
-    MPI_Request request[numSensors];
-	MPI_Status status[numSensors]; //all sensors have a possible chance of sending alert to base station, space for each send
+    MPI_Request request[numSensors+1];
+	MPI_Status status[numSensors+1]; //indexed by world rank (1 to numSensors). All sensors have a possible chance of sending alert to base station, space for each send
+
+	//The initial values for alerts from sensors is 0 (no alerts)
+    int sensorTrueAlerts[numSensors];
+    int sensorFalseAlerts[numSensors];
+    int sensorEvents[numSensors];   //number of events raised by every sensor
+    for (int a=0; a<numSensors; a++) {
+        sensorTrueAlerts[a] = 0;
+        sensorFalseAlerts[a] = 0;
+        sensorEvents[a] = 0;
+    }
+    int totalMsgCount = 0;
+
+    //Streaming statistics of every sensor, updated with every alert and logged every statsSnapshotInterval iterations
+    struct sensorStats stats;
+    int statsOpen = 1;
+    if (sensorStatsInit(&stats, numSensors, statsHalfLife, heightTolerance) != 0){
+        printf("WARNING: could not allocate the sensor statistics. No snapshots are logged\n");
+        statsOpen = 0;
+    }
+    
+    //Liveness of the sensors. A sensor is degraded while at least one neighbour reports it missed the deadline
+    int sensorDegradedReports[numSensors];
+    int sensorDegradedEvents[numSensors];
+    for (int a=0; a<numSensors; a++) {
+        sensorDegradedReports[a] = 0;
+        sensorDegradedEvents[a] = 0;
+    }
+    
+
+    //Checkpoint buffer: the header, the base station state and the per sensor counts. The buffered alerts of the
+    //store follow, so the buffer grows at every checkpoint to hold them
+    int checkpointFixedSize = sizeof(struct checkpointHeader) + sizeof(struct baseCheckpoint) + BASE_CHECKPOINT_COUNTS * numSensors * sizeof(int32_t);
+    char *checkpointBuffer = (char*)calloc(checkpointFixedSize, 1);
+    struct checkpointHeader *ckptHeader = (struct checkpointHeader*)checkpointBuffer;
+    struct baseCheckpoint *ckptState = (struct baseCheckpoint*)(checkpointBuffer + sizeof(struct checkpointHeader));
+    int32_t *ckptCounts = (int32_t*)(checkpointBuffer + sizeof(struct checkpointHeader) + sizeof(struct baseCheckpoint));
+    int checkpointCount = 0;
+    double checkpointTime = 0.0;
+    int restored = 0;
+    struct alertRecord *restoredTail = NULL; //buffered alerts of the store at the checkpoint
+
+    //Continue from the checkpoint instead. Collective with the sensors, before the satellite starts writing its readings
+    if (restart == 1){
+        if (checkpointRead(commWorld, checkpointBaseOffset(numSensors), checkpointBuffer, checkpointFixedSize) == 0 
+            && memcmp(ckptHeader->magic, CHECKPOINT_MAGIC, 8) == 0 && ckptHeader->numSensors == numSensors){
+            baseIterCount = ckptState->baseIterCount;
+            totalMsgCount = ckptState->totalMsgCount;
+            nextIndex = ckptState->nextIndex;
+            satReadCount = ckptState->satReadCount;
+            checkpointCount = ckptState->checkpointCount;
+            totalCommTime = ckptState->totalCommTime;
+            checkpointTime = ckptState->checkpointTime + ckptState->lastCheckpointTime;
+            memcpy(satReadings, ckptState->satReadings, sizeof(satReadings));
+            for (int a=0; a<numSensors; a++) {
+                sensorTrueAlerts[a] = ckptCounts[a];
+                sensorFalseAlerts[a] = ckptCounts[numSensors + a];
+                sensorEvents[a] = ckptCounts[2*numSensors + a];
+                sensorDegradedEvents[a] = ckptCounts[3*numSensors + a];
+            }
+            restored = 1;
+
+            //The buffered alerts are only needed by the base station, so they are read without the sensors
+            if (ckptState->storeTailRecords > 0){
+                restoredTail = (struct alertRecord*)malloc(ckptState->storeTailRecords * sizeof(struct alertRecord));
+                FILE* ckptFile = fopen(CHECKPOINT_PATH, "rb");
+                if (ckptFile == NULL || fseek(ckptFile, (long)checkpointBaseOffset(numSensors) + checkpointFixedSize, SEEK_SET) != 0
+                    || fread(restoredTail, sizeof(struct alertRecord), ckptState->storeTailRecords, ckptFile) != (size_t)ckptState->storeTailRecords){
+                    printf("WARNING: could not read the buffered alerts from %s. They are missing from the alert store\n", CHECKPOINT_PATH);
+                    ckptState->storeTailRecords = 0;
+                }
+                if (ckptFile != NULL)
+                    fclose(ckptFile);
+            }
+        }
+        else
+            printf("WARNING: could not restore the base station from %s, starting fresh\n", CHECKPOINT_PATH);
+    }
 
     pthread_t hThread[NUM_THREADS]; // Stores the POSIX thread IDs
 	int threadNum[NUM_THREADS]; // Pass a unique thread ID
@@ -171,26 +463,38 @@ void baseStationSubroutine(float waterThreshold, float maxWaterHeight, int nbase
 	pthread_create(&hThread[0], NULL, userEnd, &threadNum[0]);
 	threadNum[1] = 1;
 	pthread_create(&hThread[1], NULL, sateliteAltimeter, &threadNum[1]);
-	
-	//The initial values for alerts from sensors is 0 (no alerts)
-    int sensorTrueAlerts[numSensors];
-    int sensorFalseAlerts[numSensors];
-    for (int a=0; a<numSensors; a++) {
-        sensorTrueAlerts[a] = 0;
-        sensorFalseAlerts[a] = 0;
-    }
-    int totalMsgCount = 0;
     
 
     // init log file with tolerance for height and time readings
     FILE* file = fopen("logs.txt", "a");
 
-    fprintf(file, "=====================    LOGS    =====================\n");
+    if (restored == 1)
+        fprintf(file, "=====================    RESTARTED FROM CHECKPOINT %d AT ITERATION %d    =====================\n", checkpointCount, baseIterCount);
+    else
+        fprintf(file, "=====================    LOGS    =====================\n");
     fprintf(file, "\nMax. tolerance for all height readings (m): %.1f\n", heightTolerance );
     fprintf(file, "Max. tolerance for all time readings (sec): %.1f\n",timeTolerance);
     fprintf(file, "Sensor grid structure: %d x %d\n\n", nrows, ncols);
 
     fclose(file); 
+    
+    //Columnar store of every alert, next to the text log. After a restart continue the store as it was at the checkpoint
+    struct alertStore store;
+    int storeOpen = 1;
+    if (restored == 1){
+        //Never create a new store here, it would wipe the alerts the restored counts include
+        if (alertStoreResume(&store, STORE_PATH, numSensors, ckptState->storeDataSize, ckptState->storeIndexSize) != 0){
+            printf("WARNING: could not continue the alert store %s. It is left as it is and alerts are only written to logs.txt\n", STORE_PATH);
+            storeOpen = 0;
+        }
+        for (int r = 0; r < ckptState->storeTailRecords && storeOpen == 1; r++)
+            alertStoreAppend(&store, &restoredTail[r]);
+        free(restoredTail);
+    }
+    else if (alertStoreOpen(&store, STORE_PATH, numSensors) != 0){
+        printf("WARNING: could not create the alert store %s. Alerts are only written to logs.txt\n", STORE_PATH);
+        storeOpen = 0;
+    }
 
     
     //Iterate while user does not provide the sentinel value
@@ -200,62 +504,26 @@ void baseStationSubroutine(float waterThreshold, float maxWaterHeight, int nbase
         sleep(4); //check every 5 seconds (similar to sensors interval
         
 
+        //Receive every status change reported by the sensors since the last iteration
+        int statusFlag = 1;
+        while (statusFlag != 0){
+            MPI_Iprobe(MPI_ANY_SOURCE, sendStatusBaseTag, commWorld, &statusFlag, MPI_STATUS_IGNORE);
+            if (statusFlag != 0)
+                receiveStatus(MPI_ANY_SOURCE, commWorld, sendStatusBaseTag, baseIterCount, sensorDegradedReports, sensorDegradedEvents);
+        }
+
         //Array to keep track if any sensors have a message
-        alertSensorFlags = (int*)calloc(numSensors, sizeof(int));
+        alertSensorFlags = (int*)calloc(numSensors+1, sizeof(int));
 
         //Check if any sensors have send an alert -> NOTE: thread per probe
         for (int i = 1; i <= numSensors; i++){
-            MPI_Iprobe(i,sendAlertBaseTag,commWorld,&alertSensorFlags[i], &status[i]);
-            
-            if (alertSensorFlags[i]!= 0){ 
-                int alertType = 0;
-                struct alert sensorAlert;
-                struct satVal satReadMatch;
-                satReadMatch.sat_coord1 = -1;
-
-                MPI_Recv(&sensorAlert, sizeof(struct alert), MPI_CHAR, i, sendAlertBaseTag, commWorld, &status[i]);
-
-                totalMsgCount += sensorAlert.numMsgs;
-                // satelite check
-                int satEnd = SATELITE_SIZE;
-                if (satReadCount < SATELITE_SIZE)
-                    satEnd = satReadCount;
-                double closestTime = INFINITY;
-                pthread_cond_wait(&g_Cond, &g_Mutex);
-                for (int j = 0; j < satEnd; j++) {
+            //Receive every alert the sensor sent since the last iteration (sensors may sample faster than the base)
+            while (1){ 
+                MPI_Iprobe(i,sendAlertBaseTag,commWorld,&alertSensorFlags[i], &status[i]);
+                if (alertSensorFlags[i] == 0)
+                    break;
                 
-                    //Check if coordinates matches
-                    if (satReadings[j].sat_coord1 == sensorAlert.sensor_coord1 && satReadings[j].sat_coord2 == sensorAlert.sensor_coord2) {
-
-                        //check if time matches between time threshold
-                        double thisTime = difftime(sensorAlert.sensorTime, satReadings[j].satTime);
-                        if (thisTime <= timeTolerance && thisTime < closestTime)
-                            closestTime = thisTime;       
-                            satReadMatch.sat_coord1 = satReadings[j].sat_coord1;
-                            satReadMatch.sat_coord2 = satReadings[j].sat_coord2;
-                            satReadMatch.satHeight = satReadings[j].satHeight;
-                            satReadMatch.satTime = satReadings[j].satTime;
-                    }
-                }
-                pthread_mutex_unlock(&g_Mutex);       
-
-                if (satReadMatch.sat_coord1 != -1) {
-                    if ((abs(satReadMatch.satHeight-sensorAlert.sensorHeight)) <= heightTolerance) {
-                        alertType = 1;    //If this is a true alert since matches the coordinates and satellite value water level
-                        sensorTrueAlerts[sensorAlert.sensorRank] +=1;
-                    } else    //If this is a false alert since matches the coordinates but not satellite value water level
-                        sensorFalseAlerts[sensorAlert.sensorRank] +=1;
-                } else {
-                    // no matching sat rec - set vals - still log record
-                    satReadMatch.sat_coord1 = -1;
-                    satReadMatch.sat_coord2 = -1;
-                    satReadMatch.satHeight = 0.0;
-                    satReadMatch.satTime = time(NULL);
-                    sensorFalseAlerts[sensorAlert.sensorRank] +=1;
-                }
-                
-                //Write the report into file
-                writeToLog(baseIterCount, sensorAlert.sensorRank, sensorAlert.sensor_coord1, sensorAlert.sensor_coord2, satReadMatch.sat_coord1, satReadMatch.sat_coord2, sensorAlert.sensorTime, satReadMatch.satTime, sensorAlert.sensorHeight, satReadMatch.satHeight, sensorAlert.similarCount, sensorAlert.neighRank, sensorAlert.neigh_coord1, sensorAlert.neigh_coord2, sensorAlert.neighHeight, alertType, sensorAlert.numMsgs);
+                receiveAlert(&status[i], commWorld, sendAlertBaseTag, baseIterCount, heightTolerance, timeTolerance, sensorTrueAlerts, sensorFalseAlerts, sensorEvents, &totalMsgCount, &store, storeOpen, &stats, statsOpen);
             }
            
         }
@@ -267,9 +535,88 @@ void baseStationSubroutine(float waterThreshold, float maxWaterHeight, int nbase
         
         //Terminate if completed the specified number of iterations for the base
         baseIterCount++;
+        if (statsOpen == 1 && statsSnapshotInterval > 0 && baseIterCount % statsSnapshotInterval == 0)
+            writeStatsToLog(baseIterCount, &stats);
         if (baseIterCount >= nbaseIters)
             baseSentinelValue = 0;
 
+        //Coordinated checkpoint every checkpointInterval iterations. Every sensor writes its part in the same collective write
+        if (checkpointInterval > 0 && baseIterCount % checkpointInterval == 0 && userSentinelValue == 1 && baseSentinelValue == 1){
+            int epoch = checkpointCount + 1;
+            for (int z=1; z<=numSensors; z++)
+                MPI_Isend(&epoch, 1, MPI_INT, z, sendCheckpointTag, commWorld, &request[z]);
+            MPI_Waitall(numSensors, &request[1], MPI_STATUSES_IGNORE);
+
+            //Receive everything the sensors sent before their checkpoint, up to the empty marker of every sensor.
+            //The sensors wait in the collective write after their marker, so nothing else arrives meanwhile
+            int numMarkers = 0;
+            while (numMarkers < numSensors){
+                int flag;
+                MPI_Status probeStatus;
+                MPI_Iprobe(MPI_ANY_SOURCE, MPI_ANY_TAG, commWorld, &flag, &probeStatus);
+                if (flag == 0){
+                    usleep(1000);
+                    continue;
+                }
+                int alertSize;
+                MPI_Get_count(&probeStatus, MPI_PACKED, &alertSize);
+                if (probeStatus.MPI_TAG == sendAlertBaseTag && alertSize == 0){
+                    MPI_Recv(NULL, 0, MPI_PACKED, probeStatus.MPI_SOURCE, sendAlertBaseTag, commWorld, MPI_STATUS_IGNORE);
+                    numMarkers += 1;
+                }
+                else if (probeStatus.MPI_TAG == sendAlertBaseTag)
+                    receiveAlert(&probeStatus, commWorld, sendAlertBaseTag, baseIterCount, heightTolerance, timeTolerance, sensorTrueAlerts, sensorFalseAlerts, sensorEvents, &totalMsgCount, &store, storeOpen, &stats, statsOpen);
+                else
+                    receiveStatus(probeStatus.MPI_SOURCE, commWorld, sendStatusBaseTag, baseIterCount, sensorDegradedReports, sensorDegradedEvents);
+            }
+
+            int tailRecords = storeOpen == 1 ? alertStoreBuffered(&store) : 0;
+            int checkpointSize = checkpointFixedSize + tailRecords * sizeof(struct alertRecord);
+            checkpointBuffer = (char*)realloc(checkpointBuffer, checkpointSize);
+            ckptHeader = (struct checkpointHeader*)checkpointBuffer;
+            ckptState = (struct baseCheckpoint*)(checkpointBuffer + sizeof(struct checkpointHeader));
+            ckptCounts = (int32_t*)(checkpointBuffer + sizeof(struct checkpointHeader) + sizeof(struct baseCheckpoint));
+
+            memcpy(ckptHeader->magic, CHECKPOINT_MAGIC, 8);
+            ckptHeader->version = CHECKPOINT_VERSION;
+            ckptHeader->numSensors = numSensors;
+            ckptHeader->epoch = epoch;
+            ckptHeader->baseSize = checkpointSize - sizeof(struct checkpointHeader);
+            ckptState->baseIterCount = baseIterCount;
+            ckptState->totalMsgCount = totalMsgCount;
+            ckptState->checkpointCount = epoch;
+            ckptState->totalCommTime = totalCommTime;
+            ckptState->checkpointTime = checkpointTime;
+            ckptState->lastCheckpointTime = 0.0;
+            ckptState->storeDataSize = 0;
+            ckptState->storeIndexSize = 0;
+            ckptState->storeTailRecords = tailRecords;
+            if (storeOpen == 1){ //the full blocks must be on disk before the checkpoint is written, the rest is in the checkpoint
+                ckptState->storeIndexSize = alertStoreFlush(&store);
+                ckptState->storeDataSize = store.offset;
+                alertStoreCopyBuffered(&store, (struct alertRecord*)(checkpointBuffer + checkpointFixedSize));
+            }
+            pthread_mutex_lock(&g_Mutex);
+            ckptState->nextIndex = nextIndex;
+            ckptState->satReadCount = satReadCount;
+            memcpy(ckptState->satReadings, satReadings, sizeof(satReadings));
+            pthread_mutex_unlock(&g_Mutex);
+            for (int a=0; a<numSensors; a++) {
+                ckptCounts[a] = sensorTrueAlerts[a];
+                ckptCounts[numSensors + a] = sensorFalseAlerts[a];
+                ckptCounts[2*numSensors + a] = sensorEvents[a];
+                ckptCounts[3*numSensors + a] = sensorDegradedEvents[a];
+            }
+
+            MPI_Offset timeOffset = checkpointBaseOffset(numSensors) + sizeof(struct checkpointHeader) + offsetof(struct baseCheckpoint, lastCheckpointTime);
+            double seconds = checkpointWrite(commWorld, checkpointBaseOffset(numSensors), checkpointBuffer, checkpointSize, timeOffset);
+            writeCheckpointToLog(baseIterCount, epoch, seconds, (long)checkpointBaseOffset(numSensors) + checkpointSize);
+            if (seconds >= 0){
+                checkpointCount = epoch;
+                checkpointTime += seconds;
+            }
+        }
+
     }
     
     //Finished the threads
@@ -285,6 +632,34 @@ void baseStationSubroutine(float waterThreshold, float maxWaterHeight, int nbase
         MPI_Isend(&val_, 1, MPI_INT, z, sendTerminationTag, commWorld, &request[z]);
     }
 
+    //Keep receiving until every sensor acknowledged the termination. A sensor only acknowledges once all its sends
+    //completed, and an alert too large to be sent eagerly only completes once it is received here.
+    //The base station only receives alerts, status messages and acknowledgements, and probing any tag keeps
+    //the messages of a sensor in the order they were sent
+    int numAcks = 0;
+    while (numAcks < numSensors){
+        int flag;
+        MPI_Status probeStatus;
+        MPI_Iprobe(MPI_ANY_SOURCE, MPI_ANY_TAG, commWorld, &flag, &probeStatus);
+        if (flag == 0){
+            usleep(1000);
+            continue;
+        }
+        if (probeStatus.MPI_TAG == sendAlertBaseTag)
+            receiveAlert(&probeStatus, commWorld, sendAlertBaseTag, baseIterCount, heightTolerance, timeTolerance, sensorTrueAlerts, sensorFalseAlerts, sensorEvents, &totalMsgCount, &store, storeOpen, &stats, statsOpen);
+        else if (probeStatus.MPI_TAG == sendStatusBaseTag)
+            receiveStatus(probeStatus.MPI_SOURCE, commWorld, sendStatusBaseTag, baseIterCount, sensorDegradedReports, sensorDegradedEvents);
+        else { //acknowledgement of the termination
+            int ackMsg;
+            MPI_Recv(&ackMsg, 1, MPI_INT, probeStatus.MPI_SOURCE, sendTerminationTag, commWorld, MPI_STATUS_IGNORE);
+            numAcks += 1;
+        }
+    }
+    MPI_Waitall(numSensors, &request[1], MPI_STATUSES_IGNORE);
+
+    if (storeOpen == 1)
+        alertStoreClose(&store);
+    free(checkpointBuffer);
 
 
     
@@ -299,22 +674,33 @@ void baseStationSubroutine(float waterThreshold, float maxWaterHeight, int nbase
     else if (baseSentinelValue == 0)
         fprintf(file, "Base completed all %d iterations of the program.\n", nbaseIters);
 
-    fprintf(file, "\nReporting Node\t\tTrue alerts\t\tFalse alerts\n");
+    fprintf(file, "\nReporting Node\t\tEvents\t\tTrue alerts\t\tFalse alerts\t\tTimes degraded\t\tDegraded at end\n");
     int totalT = 0;
     int totalF = 0;
+    int totalDegraded = 0;
     for (int i=0; i<numSensors; i++) {
-        fprintf(file,"%d\t\t\t\t\t%d\t\t\t\t%d\n", i, sensorTrueAlerts[i], sensorFalseAlerts[i]);
+        fprintf(file,"%d\t\t\t\t\t%d\t\t\t%d\t\t\t\t%d\t\t\t\t%d\t\t\t\t%s\n", i, sensorEvents[i], sensorTrueAlerts[i], sensorFalseAlerts[i], sensorDegradedEvents[i], sensorDegradedReports[i] > 0 ? "Yes" : "No");
         totalT += sensorTrueAlerts[i];
         totalF += sensorFalseAlerts[i];
+        if (sensorDegradedReports[i] > 0)
+            totalDegraded += 1;
     }
     fprintf(file, "\nTotal True alerts: %d\n", totalT);
     fprintf(file, "Total False alerts: %d\n", totalF);
+    fprintf(file, "Sensors degraded at end: %d\n", totalDegraded);
     fprintf(file, "Total Communication time (seconds): %.3f\n", totalCommTime);
+    fprintf(file, "Checkpoints written: %d. Total checkpoint time (seconds): %.4f\n", checkpointCount, checkpointTime);
 
-    fprintf(file, "Number of messages passed through the network when an alert is detected (sensor with neighbours and base): 2*(number of neighbours)+1\n");
+    fprintf(file, "Number of messages passed through the network when an event is raised or summarised (sensor with neighbours and base): 2*(number of neighbours)+1\n");
+    fprintf(file, "Number of messages passed through the network when an event is cleared: 1\n");
     fprintf(file, "Total number of messages through the network due to alerts: %d\n", totalMsgCount);
 
     fprintf(file, "=========================================================\n");
     fclose(file); 
 
+    if (statsOpen == 1){
+        writeStatsToLog(baseIterCount, &stats);
+        sensorStatsFree(&stats);
+    }
+
 }
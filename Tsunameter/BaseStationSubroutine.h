@@ -3,7 +3,9 @@
 
 //Function for the base station
 //Arguments: water threshold to send alert, comm handler for the 2d grid, comm handle for the world. number of sensors from user input
-//Message tags for sendAlertBase
-void baseStationSubroutine(float waterThreshold, float maxWaterHeight, int nbaseIters, int nrows, int ncols, MPI_Comm commWorld, int sendAlertBaseTag, int sendTerminationTag, int numSensors, float heightTolerance, float timeTolerance);
+//Message tags for sendAlertBase, termination and the neighbour status (degraded/recovered) reports
+//Tag of the checkpoint message, iterations between two checkpoints (0 for none) and 1 to restore the state from the checkpoint file
+//Half life in seconds of the decayed alert rates, and the iterations between two snapshots of the sensor statistics
+void baseStationSubroutine(float waterThreshold, float maxWaterHeight, int nbaseIters, int nrows, int ncols, MPI_Comm commWorld, int sendAlertBaseTag, int sendTerminationTag, int sendStatusBaseTag, int numSensors, float heightTolerance, float timeTolerance, int sendCheckpointTag, int checkpointInterval, int restart, double statsHalfLife, int statsSnapshotInterval);
 
 #endif
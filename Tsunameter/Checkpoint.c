@@ -0,0 +1,84 @@
+#include <stdio.h>
+#include <string.h>
+#include <mpi.h>
+#include "Checkpoint.h"
+
+MPI_Offset checkpointSensorOffset(int node){
+    return (MPI_Offset)node * sizeof(struct sensorCheckpoint);
+}
+
+MPI_Offset checkpointBaseOffset(int numSensors){
+    return (MPI_Offset)numSensors * sizeof(struct sensorCheckpoint);
+}
+
+double checkpointWrite(MPI_Comm comm, MPI_Offset offset, void *data, int size, MPI_Offset timeOffset){
+    MPI_File file;
+    int rank, ierr;
+    double start = MPI_Wtime();
+
+    MPI_Comm_rank(comm, &rank);
+
+    ierr = MPI_File_open(comm, CHECKPOINT_TMP_PATH, MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &file);
+    if (ierr != MPI_SUCCESS)
+        return -1.0;
+
+    //A file left by an earlier checkpoint may be longer than this one, so start from an empty file
+    ierr = MPI_File_set_size(file, 0);
+
+    //Every rank writes its own part in the same collective call
+    if (ierr == MPI_SUCCESS)
+        ierr = MPI_File_write_at_all(file, offset, data, size, MPI_BYTE, MPI_STATUS_IGNORE);
+    MPI_File_close(&file);
+
+    //Only replace the previous checkpoint once every rank wrote its part
+    int allOk;
+    int thisOk = ierr == MPI_SUCCESS;
+    MPI_Allreduce(&thisOk, &allOk, 1, MPI_INT, MPI_MIN, comm);
+    if (allOk == 0)
+        return -1.0;
+    double seconds = MPI_Wtime() - start;
+
+    //The cost is only known once written, so rank 0 adds it to the file before it replaces the previous checkpoint
+    if (rank == 0){
+        if (timeOffset >= 0){
+            ierr = MPI_File_open(MPI_COMM_SELF, CHECKPOINT_TMP_PATH, MPI_MODE_WRONLY, MPI_INFO_NULL, &file);
+            if (ierr == MPI_SUCCESS){
+                ierr = MPI_File_write_at(file, timeOffset, &seconds, 1, MPI_DOUBLE, MPI_STATUS_IGNORE);
+                MPI_File_close(&file);
+            }
+            if (ierr != MPI_SUCCESS)
+                return -1.0;
+        }
+        rename(CHECKPOINT_TMP_PATH, CHECKPOINT_PATH);
+    }
+
+    return seconds;
+}
+
+int checkpointRead(MPI_Comm comm, MPI_Offset offset, void *data, int size){
+    MPI_File file;
+    int ierr;
+
+    ierr = MPI_File_open(comm, CHECKPOINT_PATH, MPI_MODE_RDONLY, MPI_INFO_NULL, &file);
+    if (ierr != MPI_SUCCESS)
+        return -1;
+
+    ierr = MPI_File_read_at_all(file, offset, data, size, MPI_BYTE, MPI_STATUS_IGNORE);
+    MPI_File_close(&file);
+    return ierr == MPI_SUCCESS ? 0 : -1;
+}
+
+int checkpointValid(int numSensors){
+    struct checkpointHeader header;
+
+    FILE* file = fopen(CHECKPOINT_PATH, "rb");
+    if (file == NULL)
+        return -1;
+
+    int ok = fseek(file, (long)checkpointBaseOffset(numSensors), SEEK_SET) == 0 && fread(&header, sizeof(header), 1, file) == 1;
+    fclose(file);
+
+    if (!ok || memcmp(header.magic, CHECKPOINT_MAGIC, 8) != 0 || header.version != CHECKPOINT_VERSION || header.numSensors != numSensors)
+        return -1;
+    return 0;
+}
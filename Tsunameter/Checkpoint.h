@@ -0,0 +1,71 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <mpi.h>
+#include <stdint.h>
+
+//Coordinated checkpoint of the sensors and the base station in a single file, written with MPI-IO.
+//
+//The base station tells every sensor to checkpoint, then all the ranks write their part with one
+//collective write. The file is laid out as:
+//    [sensor 0] [sensor 1] ... [sensor n-1] [header] [base station state]
+//so every offset only depends on the number of sensors. The file is written to CHECKPOINT_TMP_PATH
+//and renamed once complete, so a crash while writing keeps the previous checkpoint.
+
+#define CHECKPOINT_PATH "tsunameter.ckpt"
+#define CHECKPOINT_TMP_PATH "tsunameter.ckpt.tmp"
+#define CHECKPOINT_MAGIC "TSUNCKPT"
+#define CHECKPOINT_VERSION 4
+
+//State of one sensor
+struct sensorCheckpoint{
+    int32_t node;              //node id of the sensor, to check the file matches the topology
+    int32_t iter;
+    float randomNumbers[4];    //the moving average window
+    float movingAverage;
+    int32_t oldestFloat;
+    int32_t alertState;
+    int32_t eventCycles;
+    int32_t cyclesSinceReport;
+    float peakHeight;
+    uint32_t seed;
+};
+
+//Start of the base station's part. The base station state follows it
+struct checkpointHeader{
+    char magic[8];
+    int32_t version;
+    int32_t numSensors;
+    int32_t epoch;             //number of checkpoints written
+    int32_t baseSize;          //bytes of the base station state after the header
+};
+
+/**
+* Offset of the sensor's part of the checkpoint file.
+**/
+MPI_Offset checkpointSensorOffset(int node);
+
+/**
+* Offset of the header (followed by the base station state).
+**/
+MPI_Offset checkpointBaseOffset(int numSensors);
+
+/**
+* Collective over comm. Every rank writes size bytes of data at offset. If timeOffset of rank 0 is not
+* negative, rank 0 then writes the seconds taken as a double at timeOffset, so the file holds its own cost.
+* Returns the seconds taken, or a negative value on error.
+**/
+double checkpointWrite(MPI_Comm comm, MPI_Offset offset, void *data, int size, MPI_Offset timeOffset);
+
+/**
+* Collective over comm. Every rank reads size bytes at offset into data. Returns 0 on success.
+**/
+int checkpointRead(MPI_Comm comm, MPI_Offset offset, void *data, int size);
+
+/**
+* Check the header of the checkpoint file matches numSensors (not collective). Returns 0 if the
+* file can be used to restart, -1 if not.
+**/
+int checkpointValid(int numSensors);
+
+#endif
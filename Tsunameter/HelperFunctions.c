@@ -19,3 +19,90 @@ float randomFloatWaterLevel(float min, float max){
     //Reference: https://stackoverflow.com/a/1344261   
     return roundf(randomFloat * 1000) /1000;
 }
+
+float randomFloatWaterLevelSeeded(float min, float max, unsigned int *seed){
+    float scale = rand_r(seed) / (float) RAND_MAX; 
+    float randomFloat =  min + scale * ( max - min );   
+    
+    //Round to 3 decimal places.
+    return roundf(randomFloat * 1000) /1000;
+}
+
+
+void allocAlert(struct alert *thisAlert, int numNeighbours){
+    int size = numNeighbours > 0 ? numNeighbours : 1;
+    thisAlert->numNeighbours = numNeighbours;
+    
+    //One block for the 3 int arrays to keep the alert compact
+    thisAlert->neighRank = (int*)malloc(3 * size * sizeof(int));
+    thisAlert->neigh_coord1 = thisAlert->neighRank + size;
+    thisAlert->neigh_coord2 = thisAlert->neighRank + 2*size;
+    thisAlert->neighHeight = (float*)malloc(size * sizeof(float));
+}
+
+void freeAlert(struct alert *thisAlert){
+    free(thisAlert->neighRank);
+    free(thisAlert->neighHeight);
+}
+
+//Reference for pack/unpack: https://www.netlib.org/utk/papers/mpi-book/node90.html
+int packAlert(struct alert *thisAlert, char **buffer, MPI_Comm comm){
+    int intSize, floatSize, longSize;
+    int n = thisAlert->numNeighbours;
+    int position = 0;
+    long sensorTime = (long)thisAlert->sensorTime;
+    
+    //Upper bound of the packed size: 8 ints, 4 floats and a long for the header, then the neighbour arrays
+    MPI_Pack_size(8 + 3*n, MPI_INT, comm, &intSize);
+    MPI_Pack_size(4 + n, MPI_FLOAT, comm, &floatSize);
+    MPI_Pack_size(1, MPI_LONG, comm, &longSize);
+    int bufferSize = intSize + floatSize + longSize;
+    *buffer = (char*)malloc(bufferSize);
+    
+    MPI_Pack(&thisAlert->sensorRank, 1, MPI_INT, *buffer, bufferSize, &position, comm);
+    MPI_Pack(&thisAlert->sensor_coord1, 1, MPI_INT, *buffer, bufferSize, &position, comm);
+    MPI_Pack(&thisAlert->sensor_coord2, 1, MPI_INT, *buffer, bufferSize, &position, comm);
+    MPI_Pack(&thisAlert->sensorLat, 1, MPI_FLOAT, *buffer, bufferSize, &position, comm);
+    MPI_Pack(&thisAlert->sensorLon, 1, MPI_FLOAT, *buffer, bufferSize, &position, comm);
+    MPI_Pack(&thisAlert->sensorHeight, 1, MPI_FLOAT, *buffer, bufferSize, &position, comm);
+    MPI_Pack(&thisAlert->similarCount, 1, MPI_INT, *buffer, bufferSize, &position, comm);
+    MPI_Pack(&sensorTime, 1, MPI_LONG, *buffer, bufferSize, &position, comm);
+    MPI_Pack(&thisAlert->numMsgs, 1, MPI_INT, *buffer, bufferSize, &position, comm);
+    MPI_Pack(&thisAlert->alertPhase, 1, MPI_INT, *buffer, bufferSize, &position, comm);
+    MPI_Pack(&thisAlert->eventCycles, 1, MPI_INT, *buffer, bufferSize, &position, comm);
+    MPI_Pack(&thisAlert->peakHeight, 1, MPI_FLOAT, *buffer, bufferSize, &position, comm);
+    MPI_Pack(&n, 1, MPI_INT, *buffer, bufferSize, &position, comm);
+    MPI_Pack(thisAlert->neighRank, n, MPI_INT, *buffer, bufferSize, &position, comm);
+    MPI_Pack(thisAlert->neigh_coord1, n, MPI_INT, *buffer, bufferSize, &position, comm);
+    MPI_Pack(thisAlert->neigh_coord2, n, MPI_INT, *buffer, bufferSize, &position, comm);
+    MPI_Pack(thisAlert->neighHeight, n, MPI_FLOAT, *buffer, bufferSize, &position, comm);
+    
+    return position;
+}
+
+void unpackAlert(char *buffer, int size, struct alert *thisAlert, MPI_Comm comm){
+    int n;
+    int position = 0;
+    long sensorTime;
+    
+    MPI_Unpack(buffer, size, &position, &thisAlert->sensorRank, 1, MPI_INT, comm);
+    MPI_Unpack(buffer, size, &position, &thisAlert->sensor_coord1, 1, MPI_INT, comm);
+    MPI_Unpack(buffer, size, &position, &thisAlert->sensor_coord2, 1, MPI_INT, comm);
+    MPI_Unpack(buffer, size, &position, &thisAlert->sensorLat, 1, MPI_FLOAT, comm);
+    MPI_Unpack(buffer, size, &position, &thisAlert->sensorLon, 1, MPI_FLOAT, comm);
+    MPI_Unpack(buffer, size, &position, &thisAlert->sensorHeight, 1, MPI_FLOAT, comm);
+    MPI_Unpack(buffer, size, &position, &thisAlert->similarCount, 1, MPI_INT, comm);
+    MPI_Unpack(buffer, size, &position, &sensorTime, 1, MPI_LONG, comm);
+    MPI_Unpack(buffer, size, &position, &thisAlert->numMsgs, 1, MPI_INT, comm);
+    MPI_Unpack(buffer, size, &position, &thisAlert->alertPhase, 1, MPI_INT, comm);
+    MPI_Unpack(buffer, size, &position, &thisAlert->eventCycles, 1, MPI_INT, comm);
+    MPI_Unpack(buffer, size, &position, &thisAlert->peakHeight, 1, MPI_FLOAT, comm);
+    MPI_Unpack(buffer, size, &position, &n, 1, MPI_INT, comm);
+    thisAlert->sensorTime = (time_t)sensorTime;
+    
+    allocAlert(thisAlert, n);
+    MPI_Unpack(buffer, size, &position, thisAlert->neighRank, n, MPI_INT, comm);
+    MPI_Unpack(buffer, size, &position, thisAlert->neigh_coord1, n, MPI_INT, comm);
+    MPI_Unpack(buffer, size, &position, thisAlert->neigh_coord2, n, MPI_INT, comm);
+    MPI_Unpack(buffer, size, &position, thisAlert->neighHeight, n, MPI_FLOAT, comm);
+}
@@ -1,11 +1,68 @@
 #ifndef HELPERFUNCTIONS_H
 #define HELPERFUNCTIONS_H
 
+#include <mpi.h>
+#include <time.h>
+
+//Phase of the event the alert is sent for. A sensor sends one alert when the event is raised, a summary
+//every few cycles while it is ongoing, and one when the water height drops below the disarm threshold.
+#define ALERT_PHASE_RAISED 0
+#define ALERT_PHASE_ONGOING 1
+#define ALERT_PHASE_CLEARED 2
+
+//Alert sent from a sensor to the base station. The neighbour arrays have numNeighbours entries,
+//so the alert is packed into a buffer (see packAlert) instead of sent as a fixed size struct.
+struct alert{
+    int sensorRank;
+    int sensor_coord1;
+    int sensor_coord2;
+    float sensorLat;
+    float sensorLon;
+    float sensorHeight;
+    int numNeighbours;
+    int *neighRank;
+    int *neigh_coord1;
+    int *neigh_coord2;
+    float *neighHeight;
+    int similarCount;
+    time_t sensorTime;
+    int numMsgs;
+    int alertPhase;     //raised, ongoing or cleared
+    int eventCycles;    //number of cycles since the event was raised
+    float peakHeight;   //highest moving average during the event
+};
+
+
+/**
+* Function to randomly generate a float value between the given minimum value and maximum value. Up to 3 decimal places.
+**/
+float randomFloatWaterLevel(float min, float max);
+
+/**
+* Same as randomFloatWaterLevel, but with the caller's seed (rand_r) instead of reseeding and sleeping every call.
+* Used by the sensors so they can sample faster than once per second.
+**/
+float randomFloatWaterLevelSeeded(float min, float max, unsigned int *seed);
+
+/**
+* Allocate the neighbour arrays of the alert for numNeighbours neighbours. The int arrays share one block.
+**/
+void allocAlert(struct alert *thisAlert, int numNeighbours);
+
+/**
+* Free the neighbour arrays of the alert.
+**/
+void freeAlert(struct alert *thisAlert);
+
+/**
+* Pack the alert into a newly allocated buffer to send as MPI_PACKED. Returns the packed size in bytes.
+**/
+int packAlert(struct alert *thisAlert, char **buffer, MPI_Comm comm);
 
 /**
-* Function to randomly generate a float value between the given minimum value and maximum value. Up to 3 decimal places. 
+* Unpack an alert from the buffer. The neighbour arrays are allocated and must be freed with freeAlert.
 **/
-float randomFloatWaterLevel(float min, float max); 
+void unpackAlert(char *buffer, int size, struct alert *thisAlert, MPI_Comm comm);
 
 
 #endif
@@ -0,0 +1,272 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "SensorStats.h"
+#include "AlertStore.h"
+
+//Scale function of the t-digest (k1). A centroid may span at most one unit of k, so the centroids
+//near the tails hold fewer values and the extreme quantiles stay accurate
+static double tdigestK(double q, double compression){
+    return compression / (2.0 * M_PI) * asin(2.0 * q - 1.0);
+}
+
+static double tdigestQ(double k, double compression){
+    if (k >= compression / 4.0)
+        return 1.0;
+    return (sin(k * 2.0 * M_PI / compression) + 1.0) / 2.0;
+}
+
+static int compareDouble(const void *a, const void *b){
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+int tdigestInit(struct tdigest *digest, double compression){
+    digest->compression = compression;
+    digest->maxCentroids = (int)ceil(compression * M_PI / 2.0) + 10;
+    digest->bufferSize = 5 * (int)compression;
+    digest->numCentroids = 0;
+    digest->bufferCount = 0;
+    digest->totalWeight = 0.0;
+    digest->min = INFINITY;
+    digest->max = -INFINITY;
+    //The centroids are merged into the second half of the arrays, then moved back
+    digest->means = (double*)malloc(2 * (size_t)(digest->maxCentroids + digest->bufferSize) * sizeof(double));
+    digest->weights = (double*)malloc(2 * (size_t)(digest->maxCentroids + digest->bufferSize) * sizeof(double));
+    digest->buffer = (double*)malloc(digest->bufferSize * sizeof(double));
+    if (digest->means == NULL || digest->weights == NULL || digest->buffer == NULL){
+        tdigestFree(digest);
+        return -1;
+    }
+    return 0;
+}
+
+//Merge the buffered values into the centroids
+static void tdigestMerge(struct tdigest *digest){
+    if (digest->bufferCount == 0)
+        return;
+
+    qsort(digest->buffer, digest->bufferCount, sizeof(double), compareDouble);
+
+    //Both the centroids and the buffer are sorted, merge them into the second half of the arrays
+    int capacity = digest->maxCentroids + digest->bufferSize;
+    double *means = digest->means + capacity;
+    double *weights = digest->weights + capacity;
+    int count = 0, c = 0, b = 0;
+    while (c < digest->numCentroids || b < digest->bufferCount){
+        if (b == digest->bufferCount || (c < digest->numCentroids && digest->means[c] <= digest->buffer[b])){
+            means[count] = digest->means[c];
+            weights[count] = digest->weights[c];
+            c++;
+        }
+        else {
+            means[count] = digest->buffer[b];
+            weights[count] = 1.0;
+            b++;
+        }
+        count++;
+    }
+    double total = digest->totalWeight + digest->bufferCount;
+
+    //Greedily combine neighbouring centroids while they stay within one unit of k
+    int numCentroids = 0;
+    double weightSoFar = 0.0;
+    double qLimit = tdigestQ(tdigestK(0.0, digest->compression) + 1.0, digest->compression);
+    double mean = means[0], weight = weights[0];
+    for (int i = 1; i < count; i++){
+        double q = (weightSoFar + weight + weights[i]) / total;
+        if (q <= qLimit){
+            weight += weights[i];
+            mean += (means[i] - mean) * weights[i] / weight;
+        }
+        else {
+            digest->means[numCentroids] = mean;
+            digest->weights[numCentroids] = weight;
+            numCentroids++;
+            weightSoFar += weight;
+            qLimit = tdigestQ(tdigestK(weightSoFar / total, digest->compression) + 1.0, digest->compression);
+            mean = means[i];
+            weight = weights[i];
+        }
+    }
+    digest->means[numCentroids] = mean;
+    digest->weights[numCentroids] = weight;
+    digest->numCentroids = numCentroids + 1;
+    digest->totalWeight = total;
+    digest->bufferCount = 0;
+}
+
+void tdigestAdd(struct tdigest *digest, double value){
+    if (isnan(value))
+        return;
+    if (value < digest->min)
+        digest->min = value;
+    if (value > digest->max)
+        digest->max = value;
+    digest->buffer[digest->bufferCount] = value;
+    digest->bufferCount++;
+    if (digest->bufferCount == digest->bufferSize)
+        tdigestMerge(digest);
+}
+
+double tdigestQuantile(struct tdigest *digest, double q){
+    tdigestMerge(digest);
+    if (digest->numCentroids == 0)
+        return NAN;
+    if (q <= 0.0)
+        return digest->min;
+    if (q >= 1.0)
+        return digest->max;
+
+    //Interpolate between the centres of the centroids around the target. The first and last
+    //centroids are interpolated with the smallest and largest values
+    double target = q * digest->totalWeight;
+    double previousCentre = 0.0, previousMean = digest->min;
+    double weightSoFar = 0.0;
+    for (int i = 0; i < digest->numCentroids; i++){
+        double centre = weightSoFar + digest->weights[i] / 2.0;
+        if (target < centre){
+            double fraction = (target - previousCentre) / (centre - previousCentre);
+            return previousMean + fraction * (digest->means[i] - previousMean);
+        }
+        previousCentre = centre;
+        previousMean = digest->means[i];
+        weightSoFar += digest->weights[i];
+    }
+    double fraction = (target - previousCentre) / (digest->totalWeight - previousCentre);
+    return previousMean + fraction * (digest->max - previousMean);
+}
+
+double tdigestCount(struct tdigest *digest){
+    return digest->totalWeight + digest->bufferCount;
+}
+
+void tdigestFree(struct tdigest *digest){
+    free(digest->means);
+    free(digest->weights);
+    free(digest->buffer);
+    digest->means = NULL;
+    digest->weights = NULL;
+    digest->buffer = NULL;
+}
+
+int sensorStatsInit(struct sensorStats *stats, int numSensors, double halfLife, float heightTolerance){
+    stats->numSensors = numSensors;
+    stats->halfLife = halfLife;
+    stats->heightTolerance = heightTolerance;
+    stats->decayedTrue = (double*)calloc(numSensors, sizeof(double));
+    stats->decayedFalse = (double*)calloc(numSensors, sizeof(double));
+    stats->decayedChecked = (double*)calloc(numSensors, sizeof(double));
+    stats->lastUpdate = (double*)calloc(numSensors, sizeof(double));
+    stats->errorEwma = (float*)calloc(numSensors, sizeof(float));
+    stats->errorCount = (int*)calloc(numSensors, sizeof(int));
+    stats->noisy = (unsigned char*)calloc(numSensors, sizeof(unsigned char));
+    if (tdigestInit(&stats->latency, STATS_TDIGEST_COMPRESSION) != 0 || stats->decayedTrue == NULL || stats->decayedFalse == NULL
+        || stats->decayedChecked == NULL || stats->lastUpdate == NULL || stats->errorEwma == NULL || stats->errorCount == NULL || stats->noisy == NULL){
+        sensorStatsFree(stats);
+        return -1;
+    }
+    return 0;
+}
+
+//Factor the decayed counts of the sensor are multiplied by from its last update until now
+static double decayFactor(struct sensorStats *stats, int sensor, double now){
+    if (stats->lastUpdate[sensor] == 0.0 || now <= stats->lastUpdate[sensor])
+        return 1.0;
+    return exp(-(now - stats->lastUpdate[sensor]) * M_LN2 / stats->halfLife);
+}
+
+//Bring the decayed counts of the sensor up to now
+static void decayTo(struct sensorStats *stats, int sensor, time_t now){
+    double decay = decayFactor(stats, sensor, (double)now);
+    stats->decayedTrue[sensor] *= decay;
+    stats->decayedFalse[sensor] *= decay;
+    stats->decayedChecked[sensor] *= decay;
+    if ((double)now > stats->lastUpdate[sensor])
+        stats->lastUpdate[sensor] = (double)now;
+}
+
+//Noisy when most of its recent checked alerts were false, or its readings are far from the satellite.
+//Returns 1 if the flag changed
+static int updateNoisy(struct sensorStats *stats, int sensor){
+    unsigned char noisy = 0;
+    double checked = stats->decayedChecked[sensor];
+    if (checked >= NOISY_MIN_WEIGHT){
+        double falseChecked = checked - stats->decayedTrue[sensor];
+        if (falseChecked / checked >= NOISY_FALSE_FRACTION || stats->errorEwma[sensor] > NOISY_ERROR_FACTOR * stats->heightTolerance)
+            noisy = 1;
+    }
+    int changed = noisy != stats->noisy[sensor];
+    stats->noisy[sensor] = noisy;
+    return changed;
+}
+
+int sensorStatsUpdate(struct sensorStats *stats, int sensor, int alertType, float heightError, double latency, time_t now){
+    if (sensor < 0 || sensor >= stats->numSensors)
+        return 0;
+
+    decayTo(stats, sensor, now);
+
+    if (alertType == ALERT_TRUE)
+        stats->decayedTrue[sensor] += 1.0;
+    else
+        stats->decayedFalse[sensor] += 1.0;
+
+    //Only an alert with a satellite reading says something about the sensor's accuracy
+    if (alertType != ALERT_NO_SATELLITE){
+        stats->decayedChecked[sensor] += 1.0;
+        if (stats->errorCount[sensor] == 0)
+            stats->errorEwma[sensor] = heightError;
+        else
+            stats->errorEwma[sensor] += STATS_EWMA_ALPHA * (heightError - stats->errorEwma[sensor]);
+        stats->errorCount[sensor] += 1;
+    }
+
+    tdigestAdd(&stats->latency, latency);
+
+    return updateNoisy(stats, sensor);
+}
+
+int sensorStatsRefresh(struct sensorStats *stats, int sensor, time_t now){
+    if (sensor < 0 || sensor >= stats->numSensors)
+        return 0;
+
+    decayTo(stats, sensor, now);
+    return updateNoisy(stats, sensor);
+}
+
+void sensorStatsWrite(struct sensorStats *stats, FILE *file, time_t now){
+    //A decayed count divided by the mean lifetime of an alert is a rate per second
+    double perMinute = 60.0 * M_LN2 / stats->halfLife;
+
+    fprintf(file, "Reporting Node\t\tTrue/min\t\tFalse/min\t\tHeight error EWMA (m)\t\tNoisy\n");
+    for (int i = 0; i < stats->numSensors; i++){
+        double decay = decayFactor(stats, i, (double)now);
+        fprintf(file, "%d\t\t\t\t\t%.3f\t\t\t%.3f\t\t\t", i, stats->decayedTrue[i] * decay * perMinute, stats->decayedFalse[i] * decay * perMinute);
+        if (stats->errorCount[i] > 0)
+            fprintf(file, "%.3f\t\t\t\t\t", stats->errorEwma[i]);
+        else
+            fprintf(file, "-\t\t\t\t\t\t");
+        fprintf(file, "%s\n", stats->noisy[i] ? "Yes" : "No");
+    }
+
+    if (tdigestCount(&stats->latency) > 0)
+        fprintf(file, "\nAlert latency (seconds) over %.0f alerts: p50 %.2f, p90 %.2f, p99 %.2f, max %.2f\n", tdigestCount(&stats->latency),
+            tdigestQuantile(&stats->latency, 0.5), tdigestQuantile(&stats->latency, 0.9), tdigestQuantile(&stats->latency, 0.99), stats->latency.max);
+    else
+        fprintf(file, "\nNo alert latency recorded yet\n");
+}
+
+void sensorStatsFree(struct sensorStats *stats){
+    free(stats->decayedTrue);
+    free(stats->decayedFalse);
+    free(stats->decayedChecked);
+    free(stats->lastUpdate);
+    free(stats->errorEwma);
+    free(stats->errorCount);
+    free(stats->noisy);
+    tdigestFree(&stats->latency);
+}
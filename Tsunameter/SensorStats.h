@@ -0,0 +1,104 @@
+#ifndef SENSORSTATS_H
+#define SENSORSTATS_H
+
+#include <stdio.h>
+#include <time.h>
+
+//Streaming statistics of the sensors, kept by the base station while it runs.
+//
+//Every alert updates its sensor in O(1): exponentially decayed counts of the true and false alerts
+//(so the rates follow the recent behaviour of the sensor), an EWMA of the height error against the
+//satellite, and the noisy flag. The latency of every alert goes into one t-digest, which buffers the
+//values and merges them into its centroids when the buffer is full. Each statistic is its own array
+//indexed by sensor, so a snapshot of every sensor reads the arrays in order.
+
+#define STATS_EWMA_ALPHA 0.2          //weight of the newest height error in the EWMA
+#define STATS_TDIGEST_COMPRESSION 100 //more centroids give more accurate quantiles
+#define NOISY_MIN_WEIGHT 5.0          //decayed number of checked alerts before a sensor can be flagged
+#define NOISY_FALSE_FRACTION 0.8      //flag a sensor when this fraction of its checked alerts are false
+#define NOISY_ERROR_FACTOR 1.0        //or when its height error EWMA is above this factor of the tolerance
+
+//t-digest of a stream of values. Centroids are sorted by mean
+struct tdigest{
+    double compression;
+    int maxCentroids;
+    int numCentroids;
+    double *means;
+    double *weights;
+    int bufferSize;
+    int bufferCount;
+    double *buffer;          //values added since the last merge
+    double totalWeight;      //of the centroids, without the buffer
+    double min;
+    double max;
+};
+
+//Statistics of every sensor, one array per statistic
+struct sensorStats{
+    int numSensors;
+    double halfLife;         //seconds for an alert to count half in the decayed rates
+    float heightTolerance;
+    double *decayedTrue;     //decayed number of true alerts
+    double *decayedFalse;    //decayed number of false alerts, including the ones without a satellite reading
+    double *decayedChecked;  //decayed number of alerts with a satellite reading, true or false
+    double *lastUpdate;      //time the decayed counts were last brought up to date
+    float *errorEwma;        //EWMA of |sensor height - satellite height|
+    int *errorCount;         //number of alerts in the EWMA
+    unsigned char *noisy;
+    struct tdigest latency;  //seconds from the sensor raising the alert to the base station receiving it
+};
+
+/**
+* Create an empty t-digest. Returns 0 on success, -1 on error.
+**/
+int tdigestInit(struct tdigest *digest, double compression);
+
+/**
+* Add a value to the t-digest.
+**/
+void tdigestAdd(struct tdigest *digest, double value);
+
+/**
+* Estimate the q quantile (0 to 1) of the values added. Returns NAN when there are none.
+**/
+double tdigestQuantile(struct tdigest *digest, double q);
+
+/**
+* Number of values added.
+**/
+double tdigestCount(struct tdigest *digest);
+
+/**
+* Free the t-digest.
+**/
+void tdigestFree(struct tdigest *digest);
+
+/**
+* Create the statistics of numSensors sensors. Returns 0 on success, -1 on error.
+**/
+int sensorStatsInit(struct sensorStats *stats, int numSensors, double halfLife, float heightTolerance);
+
+/**
+* Add a classified alert of the sensor (alertType from AlertStore.h). heightError is only used when the alert
+* had a satellite reading. Returns 1 if the noisy flag of the sensor changed, 0 if not.
+**/
+int sensorStatsUpdate(struct sensorStats *stats, int sensor, int alertType, float heightError, double latency, time_t now);
+
+/**
+* Decay the counts of the sensor to now and evaluate its noisy flag again, so a sensor which went quiet
+* is no longer flagged once its recent alerts decayed. Returns 1 if the noisy flag changed, 0 if not.
+**/
+int sensorStatsRefresh(struct sensorStats *stats, int sensor, time_t now);
+
+/**
+* Write a snapshot of every sensor and the latency quantiles to file, with the rates decayed to now.
+* Call sensorStatsRefresh first for the noisy flags to be up to date.
+**/
+void sensorStatsWrite(struct sensorStats *stats, FILE *file, time_t now);
+
+/**
+* Free the statistics.
+**/
+void sensorStatsFree(struct sensorStats *stats);
+
+#endif
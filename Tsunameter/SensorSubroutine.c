@@ -1,234 +1,524 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <mpi.h>
 #include <math.h>
 #include <time.h>
 #include <unistd.h>
-#include <pthread.h>
 #include "SensorSubroutine.h"
 #include "HelperFunctions.h"
-#define NUM_THREADS 1
-#define SEND_TERMINATION_TAG 13
-#define NEIGHBOUR_TERMINATED_FLAG 14
-
-//Struct for base station alert
-struct alert{
-    int sensorRank;
-    int sensor_coord1;
-    int sensor_coord2;
-    float sensorHeight;
-    int neighRank[4];
-    int neigh_coord1[4];
-    int neigh_coord2[4];
-    float neighHeight[4];
-    int similarCount;
-    time_t sensorTime;
-    int numMsgs;
+#include "Checkpoint.h"
+
+#define SEND_POOL_SIZE 64      //number of sends which can be in flight at the same time
+#define SENSOR_POLL_USEC 1000  //sleep between two rounds of polling when there is nothing to do
+
+//State of the sensor's alert. The raised/ongoing/cleared phases sent to the base are in HelperFunctions.h
+#define SENSOR_IDLE 0
+#define SENSOR_IN_EVENT 1
+
+//Reply to a neighbour's request for the average. The cycle of the request is echoed back as a heartbeat,
+//so a late reply from an earlier cycle is not mistaken for the current one.
+struct neighbourReply{
+    float average;
+    int cycle;
+};
+
+//Pool of non-blocking sends. A slot owns its buffer until MPI_Testsome reports the send as completed,
+//so the sensor never waits for a send to finish before moving on to the next cycle.
+struct sendPool{
+    MPI_Request requests[SEND_POOL_SIZE];  //MPI_REQUEST_NULL when the slot is free
+    void *buffers[SEND_POOL_SIZE];
+    int indices[SEND_POOL_SIZE];           //for MPI_Testsome/MPI_Waitsome
+};
+
+//The neighbour exchange of one cycle. It stays in flight while the next cycles are sampled.
+struct exchange{
+    int active;               //if the requests were sent and the exchange is not evaluated yet
+    int cycle;                //cycle the requests were sent in
+    double start;             //when the requests were sent, for the deadline
+    float average;            //moving average of this sensor in that cycle
+    int numMessages;          //messages sent between this sensor and its neighbours
+    struct neighbourReply *replies;
+    float *receivedValues;    //stays 0.0 for a neighbour which did not reply
+    int *replied;
 };
 
-int endFlag = 0;
-// base end message check
-void *baseEnd(void *pArg) {
-    MPI_Comm commWorld = pArg;
+//Shared by the functions of the sensor routine. Set at the start of sensorRoutine
+static struct topology *sensorTopo;
+static MPI_Comm sensorCommWorld;
+static int sensorAlertBaseTag, sensorStatusBaseTag;
+static struct sendPool pool;
+
+static void poolInit(){
+    for (int i = 0; i < SEND_POOL_SIZE; i++){
+        pool.requests[i] = MPI_REQUEST_NULL;
+        pool.buffers[i] = NULL;
+    }
+}
+
+//Free the buffers of the sends reported as completed in pool.indices
+static void poolFreeCompleted(int outcount){
+    for (int i = 0; i < outcount && outcount != MPI_UNDEFINED; i++){
+        free(pool.buffers[pool.indices[i]]);
+        pool.buffers[pool.indices[i]] = NULL;
+    }
+}
+
+//Free the buffers of the sends which completed
+static void poolProgress(){
+    int outcount;
+    MPI_Testsome(SEND_POOL_SIZE, pool.requests, &outcount, pool.indices, MPI_STATUSES_IGNORE);
+    poolFreeCompleted(outcount);
+}
+
+//Start a send of buffer (allocated with malloc). The pool frees the buffer once the send completed
+static void poolSend(void *buffer, int count, MPI_Datatype datatype, int dest, int tag, MPI_Comm comm){
+    int slot = -1;
+    while (slot == -1){
+        for (int i = 0; i < SEND_POOL_SIZE && slot == -1; i++){
+            if (pool.requests[i] == MPI_REQUEST_NULL && pool.buffers[i] == NULL)
+                slot = i;
+        }
+        if (slot == -1){ //every slot is in flight, wait for at least one
+            int outcount;
+            MPI_Waitsome(SEND_POOL_SIZE, pool.requests, &outcount, pool.indices, MPI_STATUSES_IGNORE);
+            poolFreeCompleted(outcount);
+        }
+    }
+    pool.buffers[slot] = buffer;
+    MPI_Isend(buffer, count, datatype, dest, tag, comm, &pool.requests[slot]);
+}
+
+//Copy the message into a new buffer and send it with the pool
+static void poolSendCopy(const void *data, int bytes, int dest, int tag, MPI_Comm comm){
+    void *buffer = malloc(bytes);
+    memcpy(buffer, data, bytes);
+    poolSend(buffer, bytes, MPI_BYTE, dest, tag, comm);
+}
+
+//Wait for every send still in flight and free the buffers
+static void poolFinish(){
+    MPI_Waitall(SEND_POOL_SIZE, pool.requests, MPI_STATUSES_IGNORE);
+    for (int i = 0; i < SEND_POOL_SIZE; i++){
+        free(pool.buffers[i]);
+        pool.buffers[i] = NULL;
+    }
+}
+
+//Tell the base station that a neighbour became degraded (missed the deadline) or recovered,
+//and how many seconds the neighbour had been silent for
+static void reportNeighbourStatus(int rank, int neighbourNode, int degraded, double silentTime){
+    int statusMsg[4] = {rank, neighbourNode, degraded, (int)silentTime};
+    int *buffer = (int*)malloc(sizeof(statusMsg));
+    memcpy(buffer, statusMsg, sizeof(statusMsg));
+    poolSend(buffer, 4, MPI_INT, 0, sensorStatusBaseTag, sensorCommWorld);
+}
 
-    while (endFlag == 0) { //Check repeatedly for the termination signal from the base station. Store in the endFlag variable
-        sleep(0.1);
-        MPI_Iprobe(0, SEND_TERMINATION_TAG, commWorld, &endFlag, MPI_STATUS_IGNORE);
+//Mark a neighbour as alive since a message was received from it. Reports to the base if it was degraded.
+static void neighbourHeard(int rank, int i, int *neighbourDegraded, double *lastHeard){
+    double now = MPI_Wtime();
+    if (neighbourDegraded[i] == 1){
+        neighbourDegraded[i] = 0;
+        reportNeighbourStatus(rank, sensorTopo->neighbours[i], 0, now - lastHeard[i]);
     }
-    int val_;    //not really needed to receive the message, just for completion sake
-    MPI_Recv( &val_, 1, MPI_INT,0 , SEND_TERMINATION_TAG, commWorld, MPI_STATUS_IGNORE);
-    return NULL;
+    lastHeard[i] = now;
 }
 
-void sensorRoutine(int rank, int coord[2], int neighbours[4],float minWaterHeight, float maxWaterHeight, float waterThreshold, MPI_Comm comm2D, MPI_Comm commWorld, int sendRequestTag, int sendAvgTag, int sendAlertBaseTag, int sendTerminationTag, float heightTolerance){
-    
-    
-    //IMPORTANT: One cycle (window for moving average) = 20 seconds, each entry of number is every 5 seconds. Can modify if needed
-     
-    //Local variables    
+//Fill in and send an alert to the base station as a packed buffer, since the size depends on the number of neighbours.
+//A cleared alert has no neighbour values, pass NULL as receivedValues.
+static void sendAlert(int rank, int coord[2], float latLon[2], float movingAverage, float *receivedValues, int countSimilar, int numMessages, int alertPhase, int eventCycles, float peakHeight){
+    struct alert thisMsg;
+    int numNeighbours = receivedValues != NULL ? sensorTopo->numNeighbours : 0;
+
+    thisMsg.numMsgs = numMessages;
+    thisMsg.sensorRank = rank;
+    thisMsg.sensor_coord1 = coord[0];
+    thisMsg.sensor_coord2 = coord[1];
+    thisMsg.sensorLat = latLon[0];
+    thisMsg.sensorLon = latLon[1];
+    thisMsg.sensorHeight = movingAverage;
+    thisMsg.similarCount = countSimilar;
+    thisMsg.alertPhase = alertPhase;
+    thisMsg.eventCycles = eventCycles;
+    thisMsg.peakHeight = peakHeight;
+    time(&thisMsg.sensorTime);
+    allocAlert(&thisMsg, numNeighbours);
+    for(int i = 0; i<numNeighbours; i++) {
+        //look up the neighbour in the topology tables (indexed by node id)
+        int neighbour = sensorTopo->neighbours[i];
+        thisMsg.neigh_coord1[i] = sensorTopo->nodeCoords[2*neighbour];
+        thisMsg.neigh_coord2[i] = sensorTopo->nodeCoords[2*neighbour+1];
+        thisMsg.neighHeight[i] = receivedValues[i]; //stays 0.0 for a neighbour which missed the deadline
+        thisMsg.neighRank[i] = neighbour;
+    }
+
+    //The pool frees the packed buffer once the send completed
+    char *alertBuffer;
+    int alertSize = packAlert(&thisMsg, &alertBuffer, sensorCommWorld);
+    poolSend(alertBuffer, alertSize, MPI_PACKED, 0, sensorAlertBaseTag, sensorCommWorld);
+    freeAlert(&thisMsg);
+}
+
+void sensorRoutine(int rank, int coord[2], float latLon[2], struct topology *topo, float minWaterHeight, float maxWaterHeight, float waterThreshold, MPI_Comm commGraph, MPI_Comm commWorld, int sendRequestTag, int sendAvgTag, int sendAlertBaseTag, int sendTerminationTag, int sendStatusBaseTag, float heightTolerance, double neighbourDeadline, float neighbourQuorum, float neighbourAgreement, float disarmThreshold, int alertSummaryCycles, double sampleInterval, int sendCheckpointTag, int sendHeartbeatTag, int restart){
+
+
+    //IMPORTANT: One window for the moving average = 4 samples, one sample every sampleInterval seconds (5 by default).
+    //The cycle is a state machine: every round it progresses the communication, evaluates the neighbour exchange
+    //once complete or past the deadline, and takes a new sample when due. So the next samples are taken while
+    //the exchange and the alert of an earlier cycle are still in flight.
+
+    //Local variables
     float randomNumbers[4];    //for the randomly generated numbers. There will be 4 numbers in total
     float movingAverage = 0.0; //float value for the average random number
     float randomFloat;         //random float value for water level
-    int alertFlag = 0;         //flag if the rank has an alert to report  
-    int position = 0;          //for the packing of buffer
+    int endFlag = 0;           //set when the base station tells the sensors to stop
+    int alertState = SENSOR_IDLE;  //if this sensor is in an event (raised and not cleared yet)
+    int eventCycles = 0;       //number of cycles the current event has lasted
+    int cyclesSinceReport = 0; //cycles since the last alert sent for the current event
+    float peakHeight = 0.0;    //highest moving average during the current event
     int iter = 1;              //Keep track of number of iteration of subroutine
-    int countRequest = 0;      //the count of requests that need to be tracked. 
-    
-    //1 index to handle the receiving of the message from base station, 4 for sending request message to 4 potential neighbours
-    //4 for receiving average from the 4 potential neighbours, and 4 for sending the average to 4 neighbours if needed 
-    MPI_Request request[13];  
-    
+    int numNeighbours = topo->numNeighbours;
+    int *neighbours = topo->neighbours;   //ranks of the neighbours in commGraph
+    int arraySize = numNeighbours > 0 ? numNeighbours : 1;
+
+    sensorTopo = topo;
+    sensorCommWorld = commWorld;
+    sensorAlertBaseTag = sendAlertBaseTag;
+    sensorStatusBaseTag = sendStatusBaseTag;
+    poolInit();
+
+    //Seed once per sensor. Different seeds across ranks, and no sleeping between the samples
+    unsigned int seed = time(NULL) ^ (getpid()<<16) ^ rank;
+
+    //The exchange of the cycle which asked the neighbours last
+    struct exchange current;
+    current.active = 0;
+    current.replies = (struct neighbourReply*)malloc(arraySize * sizeof(struct neighbourReply));
+    current.receivedValues = (float*)malloc(arraySize * sizeof(float));
+    current.replied = (int*)malloc(arraySize * sizeof(int));
+
+    //Receives which are always posted, completed with MPI_Testsome:
+    //[0, n) requests from the neighbours, [n, 2n) replies to this sensor's requests, [2n] termination from base,
+    //[2n+1] checkpoint from base, [2n+2, 3n+2) heartbeats from the neighbours
+    int numRecvs = 3*numNeighbours + 2;
+    MPI_Request *recvRequests = (MPI_Request*)malloc(numRecvs * sizeof(MPI_Request));
+    int *recvIndices = (int*)malloc(numRecvs * sizeof(int));
+    int *requestCycles = (int*)malloc(arraySize * sizeof(int));
+    int *heartbeatCycles = (int*)malloc(arraySize * sizeof(int));
+    int terminationMsg;
+    for (int i = 0; i < numNeighbours; i++){
+        MPI_Irecv(&requestCycles[i], 1, MPI_INT, neighbours[i], sendRequestTag, commGraph, &recvRequests[i]);
+        recvRequests[numNeighbours + i] = MPI_REQUEST_NULL; //posted when an exchange starts
+        MPI_Irecv(&heartbeatCycles[i], 1, MPI_INT, neighbours[i], sendHeartbeatTag, commGraph, &recvRequests[2*numNeighbours + 2 + i]);
+    }
+    MPI_Irecv(&terminationMsg, 1, MPI_INT, 0, sendTerminationTag, commWorld, &recvRequests[2*numNeighbours]);
+    int checkpointEpoch;
+    MPI_Irecv(&checkpointEpoch, 1, MPI_INT, 0, sendCheckpointTag, commWorld, &recvRequests[2*numNeighbours+1]);
+
+    //Liveness of the neighbours. A neighbour is degraded when it misses the deadline of an exchange, or when nothing
+    //(not even a heartbeat) arrived from it for the deadline and one sample interval. It recovers once heard from again
+    int *neighbourDegraded = (int*)calloc(arraySize, sizeof(int));
+    double *lastHeard = (double*)malloc(arraySize * sizeof(double));
+    for (int i = 0; i < numNeighbours; i++)
+        lastHeard[i] = MPI_Wtime();
+
+    //The minimum number of neighbours which must reply before the alert is evaluated
+    int quorum = (int)ceilf(neighbourQuorum * numNeighbours);
+
+    //The number of similar neighbours needed to raise an event. Relative to the number of neighbours so it works
+    //for a buoy with one neighbour as well as for a large radius r neighbourhood
+    int agreement = (int)ceilf(neighbourAgreement * numNeighbours);
+    if (agreement < 1)
+        agreement = 1;
+
     //Generate the first 4 random numbers before getting the moving average value
     for (int i = 0; i < 4; i++){
-        randomNumbers[i] = randomFloatWaterLevel(minWaterHeight, maxWaterHeight);
+        randomNumbers[i] = randomFloatWaterLevelSeeded(minWaterHeight, maxWaterHeight, &seed);
     }
-    
+
     //Find initial moving average value. Sum first
     for (int i = 0; i < 4; i++){
-        movingAverage += randomNumbers[i]; 
+        movingAverage += randomNumbers[i];
     }
-    
+
     //Divide to get average
     movingAverage = movingAverage/4;
-    
+
     //round the value to 3 dp
     movingAverage = roundf(movingAverage * 1000) /1000;
-    
+
     //This will keep track of the oldest random float in the randomNumbers array. New floats will overwrite the index
-    int oldestFloat = 0;  
+    int oldestFloat = 0;
 
+    //Continue from the checkpoint instead. Collective with the base station and the other sensors
+    struct sensorCheckpoint state;
+    if (restart == 1){
+        if (checkpointRead(commWorld, checkpointSensorOffset(rank), &state, sizeof(state)) == 0 && state.node == rank){
+            iter = state.iter;
+            for (int i = 0; i < 4; i++)
+                randomNumbers[i] = state.randomNumbers[i];
+            movingAverage = state.movingAverage;
+            oldestFloat = state.oldestFloat;
+            alertState = state.alertState;
+            eventCycles = state.eventCycles;
+            cyclesSinceReport = state.cyclesSinceReport;
+            peakHeight = state.peakHeight;
+            seed = state.seed;
+        }
+        else
+            printf("WARNING: sensor %d could not restore from %s, starting fresh\n", rank, CHECKPOINT_PATH);
+    }
 
-    pthread_t hThread[NUM_THREADS];
-    int threadNum[NUM_THREADS];  
-    threadNum[0] = 0;
-	pthread_create(&hThread[0], NULL, baseEnd, commWorld);
+    double nextSample = MPI_Wtime() + sampleInterval;
 
-    //Continue while base station has not signal it to stop    
+    //Continue while base station has not signal it to stop
     while (endFlag == 0){
-        
-    
-        //Reset the counter which manages all the request once all of the requests are completed
-        countRequest = 0;
-        
-        alertFlag = 0; //reset the flag for new round
-        
-        //The number of messages to communicate with base station to send alert
-        int numMessages = 0; 
-        
-        //Wait for 4 seconds for the next interval. The generation of random float level will take 1 second. In total 5 seconds.
-        sleep(4);
-        
-        //A new random float will replace the oldest float in the array
-        randomFloat = randomFloatWaterLevel( minWaterHeight, maxWaterHeight);
-        
-        
-        //Get the new movingAverage value
-        // ((old sum) - oldest float + new float) /4 = new average 
-        movingAverage = ((movingAverage * 4) - randomNumbers[oldestFloat] + randomFloat) / 4;
-        
-        //Round to 3dp
-        movingAverage = roundf(movingAverage * 1000) /1000;
-        
-        randomNumbers[oldestFloat] = randomFloat; //replace the oldest float
-        
-        //increase the index of oldest float
-        oldestFloat = (oldestFloat + 1) % 4;
-            
-        //receive values from all neighbours. Default value for neighbours is 0.0
-        float receivedValues[4] = {0.0,0.0,0.0,0.0};
-  
-        //Array to keep track if the neighbours are having alert (they will send a message to this process to ask for movingAverage
-        int alertNeighbourFlags[4] = {0,0,0,0};
-        
-        struct alert thisMsg;
-        int countSimilar = 0;
-                        
-
-        
-        //If the moving average is greater than the predefined threshold, check with neighbour values
-        if (movingAverage > waterThreshold && endFlag == 0){  
-            alertFlag = 1;
-            
-            for (int i = 0; i < 4; i++){ //send a message to get the average from the neigbours
-                if (neighbours[i] != -2){ //if this rank have this active neighbour 
-                    
-                    //Send a request to get the average from neighbour i. 
-                    MPI_Isend(&alertFlag, 1, MPI_INT, neighbours[i], sendRequestTag, comm2D,  &request[countRequest]);  
-                    //Receive the average from neighbour i
-                    MPI_Irecv(&receivedValues[i],1,MPI_FLOAT, neighbours[i], sendAvgTag, comm2D, &request[countRequest+1] );
-                    
-                    countRequest += 2; //increase the count
-                    numMessages += 2;
-                    
-                }
+
+        int idle = 1; //sleep a little at the end of the round if there was nothing to do
+
+        /* 1. Progress the communication */
+        int outcount;
+        MPI_Testsome(numRecvs, recvRequests, &outcount, recvIndices, MPI_STATUSES_IGNORE);
+        for (int k = 0; k < outcount && outcount != MPI_UNDEFINED; k++){
+            int index = recvIndices[k];
+            idle = 0;
+
+            if (index < numNeighbours){ //a neighbour asked for the average. Reply and wait for its next request
+                int i = index;
+                struct neighbourReply reply;
+                reply.average = movingAverage;
+                reply.cycle = requestCycles[i];
+                neighbourHeard(rank, i, neighbourDegraded, lastHeard);
+                poolSendCopy(&reply, sizeof(struct neighbourReply), neighbours[i], sendAvgTag, commGraph);
+                MPI_Irecv(&requestCycles[i], 1, MPI_INT, neighbours[i], sendRequestTag, commGraph, &recvRequests[i]);
             }
-        } 
-        
-        for (int i = 0; i < 4; i++){
-            if (neighbours[i] != -2){ //if this rank have this active neighbour
-                
-                //Check if this neighbour needs the movingAverage and store this flag inside the array
-                MPI_Iprobe(neighbours[i],sendRequestTag,comm2D,&alertNeighbourFlags[i],MPI_STATUS_IGNORE);
-                if (alertNeighbourFlags[i]!= 0){ //if the neighbour asked for the average, send it to them
-                    MPI_Isend(&movingAverage, 1, MPI_FLOAT, neighbours[i], sendAvgTag, comm2D, &request[countRequest]);
-                    countRequest += 1;
+            else if (index < 2*numNeighbours){ //reply from a neighbour
+                int i = index - numNeighbours;
+                if (current.active == 1 && current.replies[i].cycle == current.cycle){
+                    current.replied[i] = 1;
+                    current.receivedValues[i] = current.replies[i].average;
+                    neighbourHeard(rank, i, neighbourDegraded, lastHeard);
                 }
+                else if (current.active == 1) //late reply from an earlier cycle, wait for the current one
+                    MPI_Irecv(&current.replies[i], sizeof(struct neighbourReply), MPI_BYTE, neighbours[i], sendAvgTag, commGraph, &recvRequests[index]);
+            }
+            else if (index == 2*numNeighbours) //termination from the base station
+                endFlag = 1;
+            else if (index > 2*numNeighbours + 1){ //heartbeat from a neighbour
+                int i = index - 2*numNeighbours - 2;
+                neighbourHeard(rank, i, neighbourDegraded, lastHeard);
+                MPI_Irecv(&heartbeatCycles[i], 1, MPI_INT, neighbours[i], sendHeartbeatTag, commGraph, &recvRequests[index]);
+            }
+            else { //checkpoint. Collective, the base station and every sensor write their part
+                //Empty message on the alert tag as a marker. Messages to the base are not reordered, so once the base
+                //receives the marker it has every alert and status message sent before this checkpoint
+                poolSend(malloc(1), 0, MPI_PACKED, 0, sendAlertBaseTag, commWorld);
+                state.node = rank;
+                state.iter = iter;
+                for (int i = 0; i < 4; i++)
+                    state.randomNumbers[i] = randomNumbers[i];
+                state.movingAverage = movingAverage;
+                state.oldestFloat = oldestFloat;
+                state.alertState = alertState;
+                state.eventCycles = eventCycles;
+                state.cyclesSinceReport = cyclesSinceReport;
+                state.peakHeight = peakHeight;
+                state.seed = seed;
+                checkpointWrite(commWorld, checkpointSensorOffset(rank), &state, sizeof(state), -1);
+                MPI_Irecv(&checkpointEpoch, 1, MPI_INT, 0, sendCheckpointTag, commWorld, &recvRequests[index]);
             }
         }
-        
-        
-        int receivedAllValues = 1;
-        for (int i = 0; i < 4; i++){
-            if (alertFlag == 1 && neighbours[i] != -2 && receivedValues[i] == 0.0)
-                receivedAllValues = 0; //if did not received the average from this neighbour yet
-        }
-        
-        int flagsRequestDone[4] = {0,0,0,0};
-        //This block of code will repeats until the alerted node gets the average from all of its neighbours
-        while (receivedAllValues == 0){ //while the rank is still waiting for an average value
-            
-            receivedAllValues = 1;
-            //check if received all average values from existing neighbours
-            for (int i = 0; i < 4; i++){
-                if (alertFlag == 1 && neighbours[i] != -2 && receivedValues[i] == 0){
-                    receivedAllValues = 0;
+        poolProgress();
+        if (endFlag == 1)
+            break;
+
+
+        /* 2. Evaluate the exchange once every neighbour replied or the deadline passed */
+        if (current.active == 1){
+            int countReplied = 0;
+            for (int i = 0; i < numNeighbours; i++)
+                countReplied += current.replied[i];
+
+            if (countReplied == numNeighbours || MPI_Wtime() - current.start > neighbourDeadline){
+                idle = 0;
+                countReplied = 0;
+                for (int i = 0; i < numNeighbours; i++){
+                    if (current.replied[i] == 0){
+                        //Stop waiting for the reply. It may still have arrived just before the cancel
+                        int cancelled;
+                        MPI_Status cancelStatus;
+                        MPI_Request *replyRequest = &recvRequests[numNeighbours + i];
+                        MPI_Cancel(replyRequest);
+                        MPI_Wait(replyRequest, &cancelStatus);
+                        MPI_Test_cancelled(&cancelStatus, &cancelled);
+                        if (cancelled == 0 && current.replies[i].cycle == current.cycle){
+                            current.replied[i] = 1;
+                            current.receivedValues[i] = current.replies[i].average;
+                            neighbourHeard(rank, i, neighbourDegraded, lastHeard);
+                        }
+                        else if (neighbourDegraded[i] == 0){ //missed the deadline
+                            neighbourDegraded[i] = 1;
+                            reportNeighbourStatus(rank, neighbours[i], 1, MPI_Wtime() - lastHeard[i]);
+                        }
+                    }
+                    countReplied += current.replied[i];
                 }
-            }            
-            //if there is an signal to stop, dont wait for it anymore
-            if (endFlag == 1)
-                receivedAllValues = 1; 
-        }
-        
-        
-        //In case you want to test the values, uncomment this section
-        //printf("Iteration %d. Rank %d. Moving average = %.3f\n", iter, rank, movingAverage);
-        //for (int i = 0; i< 4; i++)
-        //    if (neighbours[i] != -2)
-        //        printf("Iteration %d. Rank %d. Received value from %d = %.3f\n", iter, rank, neighbours[i], receivedValues[i]);
-
-
-        if (endFlag == 0){ //only continue with checking and sending alert to base station if not terminating
-            for (int i = 0; i<4; i++){
-            
-                //Check if similar to the movingAverage +- threshold
-                if (receivedValues[i] >= movingAverage - heightTolerance && receivedValues[i] <= movingAverage + heightTolerance)
-                    countSimilar += 1;
-            }
-            
-            //Check to see if need to report to base station
-            if (countSimilar >= 2){
-                
-                //added new message to base station
-                numMessages += 1;
-                thisMsg.numMsgs = numMessages;
-                
-                thisMsg.sensorRank = rank;
-                thisMsg.sensor_coord1 = coord[0];
-                thisMsg.sensor_coord2 = coord[1];
-                thisMsg.sensorHeight = movingAverage;
-                thisMsg.similarCount = countSimilar;
-                time(&thisMsg.sensorTime);
-                for(int i = 0; i<4; i++) {
-                    if (neighbours[i] != -2){
-                        int thisCoord[2];
-                        MPI_Cart_coords(comm2D, neighbours[i], 2, thisCoord);
-                        thisMsg.neigh_coord1[i] = thisCoord[0];
-                        thisMsg.neigh_coord2[i] = thisCoord[1];
-                        thisMsg.neighHeight[i] = receivedValues[i];
-                        thisMsg.neighRank[i] = neighbours[i];
+                current.active = 0;
+
+
+                //In case you want to test the values, uncomment this section
+                //printf("Iteration %d. Rank %d. Moving average = %.3f\n", current.cycle, rank, current.average);
+                //for (int i = 0; i< numNeighbours; i++)
+                //        printf("Iteration %d. Rank %d. Received value from %d = %.3f\n", current.cycle, rank, neighbours[i], current.receivedValues[i]);
+
+                //only continue with checking and sending alert to base station if enough neighbours replied
+                if (countReplied >= quorum){
+                    int countSimilar = 0;
+                    for (int i = 0; i<numNeighbours; i++){
+
+                        //Check if similar to the movingAverage +- threshold. Degraded neighbours did not reply so are skipped
+                        if (current.replied[i] == 1 && current.receivedValues[i] >= current.average - heightTolerance && current.receivedValues[i] <= current.average + heightTolerance)
+                            countSimilar += 1;
                     }
-                    else{ //give a default value to the non existant neighbour rank. Used for checking later
-                        thisMsg.neighRank[i] = -2;
+
+                    //Check to see if need to report to base station. A new event needs enough similar neighbours to be raised,
+                    //an ongoing event sends its periodic summary with whatever the neighbours reported
+                    if (alertState == SENSOR_IDLE && countSimilar >= agreement){
+                        alertState = SENSOR_IN_EVENT;
+                        eventCycles = 1;
+                        peakHeight = current.average;
+                        cyclesSinceReport = 0;
+                        current.numMessages += 1; //added new message to base station
+                        sendAlert(rank, coord, latLon, current.average, current.receivedValues, countSimilar, current.numMessages, ALERT_PHASE_RAISED, eventCycles, peakHeight);
+                    }
+                    else if (alertState == SENSOR_IN_EVENT){
+                        cyclesSinceReport = 0;
+                        current.numMessages += 1;
+                        sendAlert(rank, coord, latLon, current.average, current.receivedValues, countSimilar, current.numMessages, ALERT_PHASE_ONGOING, eventCycles, peakHeight);
                     }
                 }
-                // send alert
-                MPI_Send(&thisMsg, sizeof(struct alert), MPI_CHAR, 0, sendAlertBaseTag, commWorld);               
-               
+            }
+        }
+
+
+        /* 3. Take a new sample when due */
+        double now = MPI_Wtime();
+        if (now >= nextSample){
+            idle = 0;
+
+            //If this rank fell behind by more than a cycle, skip the missed samples instead of bursting
+            int fellBehind = 0;
+            nextSample += sampleInterval;
+            if (nextSample < now){
+                nextSample = now + sampleInterval;
+                fellBehind = 1;
+            }
+
+            //A new random float will replace the oldest float in the array
+            randomFloat = randomFloatWaterLevelSeeded(minWaterHeight, maxWaterHeight, &seed);
+
+
+            //Get the new movingAverage value
+            // ((old sum) - oldest float + new float) /4 = new average
+            movingAverage = ((movingAverage * 4) - randomNumbers[oldestFloat] + randomFloat) / 4;
+
+            //Round to 3dp
+            movingAverage = roundf(movingAverage * 1000) /1000;
+
+            randomNumbers[oldestFloat] = randomFloat; //replace the oldest float
+
+            //increase the index of oldest float
+            oldestFloat = (oldestFloat + 1) % 4;
+
+            //Keep track of the event. Only the transitions and the periodic summaries are sent to the base station
+            if (alertState == SENSOR_IN_EVENT){
+                eventCycles += 1;
+                cyclesSinceReport += 1;
+                if (movingAverage > peakHeight)
+                    peakHeight = movingAverage;
+            }
+
+            //If the moving average is greater than the predefined threshold, check with neighbour values.
+            //During an event the neighbours are only asked again when the summary is due.
+            //Only one exchange is in flight at a time, a new one starts in a later cycle.
+            int newEvent = alertState == SENSOR_IDLE && movingAverage > waterThreshold;
+            int summaryDue = alertState == SENSOR_IN_EVENT && cyclesSinceReport >= alertSummaryCycles && movingAverage >= disarmThreshold;
+
+            //The event is cleared once the average drops below the disarm threshold
+            int asked = 0;
+            if (alertState == SENSOR_IN_EVENT && movingAverage < disarmThreshold && current.active == 0){
+                alertState = SENSOR_IDLE;
+                sendAlert(rank, coord, latLon, movingAverage, NULL, 0, 1, ALERT_PHASE_CLEARED, eventCycles, peakHeight);
+            }
+            else if ((newEvent || summaryDue) && current.active == 0){
+                asked = 1;
+                current.active = 1;
+                current.cycle = iter;
+                current.start = now;
+                current.average = movingAverage;
+                current.numMessages = 0;
+
+                for (int i = 0; i < numNeighbours; i++){ //send a message to get the average from the neigbours
+                    current.replied[i] = 0;
+                    current.receivedValues[i] = 0.0;
+
+                    //Send a request to get the average from neighbour i. The cycle is sent so the reply can be matched
+                    int *requestCycle = (int*)malloc(sizeof(int));
+                    *requestCycle = iter;
+                    poolSend(requestCycle, 1, MPI_INT, neighbours[i], sendRequestTag, commGraph);
+                    //Receive the average from neighbour i
+                    MPI_Irecv(&current.replies[i], sizeof(struct neighbourReply), MPI_BYTE, neighbours[i], sendAvgTag, commGraph, &recvRequests[numNeighbours + i]);
+
+                    current.numMessages += 2;
+                }
+            }
+
+            //Heartbeat every cycle, so the neighbours know this sensor is alive while it does not ask them.
+            //A request above already tells them
+            if (asked == 0){
+                for (int i = 0; i < numNeighbours; i++){
+                    int *heartbeat = (int*)malloc(sizeof(int));
+                    *heartbeat = iter;
+                    poolSend(heartbeat, 1, MPI_INT, neighbours[i], sendHeartbeatTag, commGraph);
+                }
+            }
+
+            //A neighbour which sent nothing for the deadline and a whole cycle is degraded, even when no exchange waits for it.
+            //Not when this sensor fell behind itself, the heartbeats may be waiting to be received
+            for (int i = 0; i < numNeighbours && fellBehind == 0; i++){
+                if (neighbourDegraded[i] == 0 && now - lastHeard[i] > neighbourDeadline + sampleInterval){
+                    neighbourDegraded[i] = 1;
+                    reportNeighbourStatus(rank, neighbours[i], 1, now - lastHeard[i]);
+                }
             }
             iter += 1;
+        }
 
-        }    
+        if (idle == 1)
+            usleep(SENSOR_POLL_USEC);
+    }
 
+    //Cancel the receives still posted and finish the sends
+    for (int i = 0; i < numRecvs; i++){
+        if (recvRequests[i] != MPI_REQUEST_NULL){
+            MPI_Cancel(&recvRequests[i]);
+            MPI_Wait(&recvRequests[i], MPI_STATUS_IGNORE);
+        }
     }
-    pthread_join(hThread[0], NULL); //join back the thread after completion
+    poolFinish();
+
+    //Acknowledge the termination. The base station keeps receiving the alerts and status messages until every
+    //sensor acknowledged, so a large alert still in flight can complete in poolFinish above
+    int ackMsg = rank;
+    MPI_Send(&ackMsg, 1, MPI_INT, 0, sendTerminationTag, commWorld);
+
+    free(current.replies);
+    free(current.receivedValues);
+    free(current.replied);
+    free(recvRequests);
+    free(recvIndices);
+    free(requestCycles);
+    free(heartbeatCycles);
+    free(neighbourDegraded);
+    free(lastHeard);
 }
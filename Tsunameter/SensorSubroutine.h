@@ -1,10 +1,17 @@
 #ifndef SENSORSUBROUTINE_H
 #define SENSORSUBROUTINE_H
 
+#include "Topology.h"
+
 //Function for the each sensor subroutine
-//Arguments: rank of current process, the process' coordinates, the neighbours' ranks (may or may not exist),  min water height 
-//that can be generated, max water height, water threshold to send alert, comm handler for the 2d grid, comm handle for the world.
+//Arguments: node id of current process, the process' coordinates and lat/lon, the topology (neighbours in the graph comm),  min water height 
+//that can be generated, max water height, water threshold to send alert, comm handler for the sensor graph, comm handle for the world.
 //Message tags for different types of messages and water height tolerance for similarity. 
-void sensorRoutine(int rank, int coord[2], int neighbours[4], float minWaterHeight, float maxWaterHeight, float waterThreshold, MPI_Comm comm2D, MPI_Comm commWorld, int sendRequestTag, int sendAvgTag, int sendAlertBaseTag, int sendTerminationTag, float heightTolerance);
+//Seconds to wait for the neighbours before marking them degraded, the fraction of neighbours which must reply to evaluate an alert,
+//and the fraction of neighbours which must report a similar height to raise an event (at least 1).
+//Water height below which a raised event is cleared, and the number of cycles between the summaries of an ongoing event.
+//Seconds between two samples of the water height. Tag of the checkpoint message, tag of the heartbeats sent to the neighbours
+//every cycle, and 1 to restore the state from the checkpoint file.
+void sensorRoutine(int rank, int coord[2], float latLon[2], struct topology *topo, float minWaterHeight, float maxWaterHeight, float waterThreshold, MPI_Comm commGraph, MPI_Comm commWorld, int sendRequestTag, int sendAvgTag, int sendAlertBaseTag, int sendTerminationTag, int sendStatusBaseTag, float heightTolerance, double neighbourDeadline, float neighbourQuorum, float neighbourAgreement, float disarmThreshold, int alertSummaryCycles, double sampleInterval, int sendCheckpointTag, int sendHeartbeatTag, int restart);
 
 #endif
@@ -0,0 +1,197 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <mpi.h>
+#include "Topology.h"
+
+#define TOPOLOGY_LINE_SIZE 4096
+
+//Add value to the array if not already inside. Returns the new count
+static int addUnique(int *array, int count, int value){
+    for (int i = 0; i < count; i++){
+        if (array[i] == value)
+            return count;
+    }
+    array[count] = value;
+    return count + 1;
+}
+
+int gridNeighbours(int node, int nrows, int ncols, int topologyType, int radius, int **neighbours){
+    int row = node / ncols;
+    int col = node % ncols;
+    int count = 0;
+
+    //The 4 and 8 neighbourhoods are the same as a radius of 1 with a different distance measure
+    if (topologyType != TOPOLOGY_RADIUS)
+        radius = 1;
+
+    //At most every cell in the (2r+1) x (2r+1) square around the node
+    *neighbours = (int*)malloc((2*radius+1)*(2*radius+1) * sizeof(int));
+
+    for (int i = row - radius; i <= row + radius; i++){
+        for (int j = col - radius; j <= col + radius; j++){
+            if (i < 0 || i >= nrows || j < 0 || j >= ncols || (i == row && j == col))
+                continue; //no wrap around, and the node is not its own neighbour
+
+            int di = abs(i - row);
+            int dj = abs(j - col);
+            int inside = 0;
+            if (topologyType == TOPOLOGY_GRID4)
+                inside = (di + dj) <= 1;                  //von Neumann neighbourhood
+            else if (topologyType == TOPOLOGY_GRID8)
+                inside = 1;                               //Moore neighbourhood
+            else
+                inside = (di*di + dj*dj) <= radius*radius;   //euclidean distance within radius
+
+            if (inside){
+                (*neighbours)[count] = i * ncols + j;
+                count++;
+            }
+        }
+    }
+    return count;
+}
+
+//Get the next line which is not empty or a comment (#). Returns 0 if no more lines
+static int nextTopologyLine(FILE *file, char *line){
+    while (fgets(line, TOPOLOGY_LINE_SIZE, file) != NULL){
+        char *start = line;
+        while (*start == ' ' || *start == '\t')
+            start++;
+        if (*start != '#' && *start != '\n' && *start != '\r' && *start != '\0')
+            return 1;
+    }
+    return 0;
+}
+
+int topologyFileNodes(const char *path){
+    char line[TOPOLOGY_LINE_SIZE];
+    int numNodes = -1;
+
+    FILE* file = fopen(path, "r");
+    if (file == NULL)
+        return -1;
+
+    if (nextTopologyLine(file, line) == 0 || sscanf(line, "%d", &numNodes) != 1)
+        numNodes = -1;
+    fclose(file);
+    return numNodes;
+}
+
+int topologyFileNeighbours(const char *path, int node, int **neighbours, float *lat, float *lon){
+    char line[TOPOLOGY_LINE_SIZE];
+    int numNodes;
+    int count = 0;
+
+    numNodes = topologyFileNodes(path);
+    if (numNodes <= 0 || node >= numNodes)
+        return -1;
+
+    FILE* file = fopen(path, "r");
+    if (file == NULL)
+        return -1;
+    nextTopologyLine(file, line); //skip the number of nodes
+
+    //A node can have every other node as a neighbour
+    *neighbours = (int*)malloc(numNodes * sizeof(int));
+    *lat = 0.0;
+    *lon = 0.0;
+
+    //Each line: node lat lon degree neighbour_1 ... neighbour_degree
+    while (nextTopologyLine(file, line) == 1){
+        int thisNode, degree, offset;
+        float thisLat, thisLon;
+        char *cursor = line;
+
+        if (sscanf(cursor, "%d %f %f %d%n", &thisNode, &thisLat, &thisLon, &degree, &offset) != 4){
+            fclose(file);
+            free(*neighbours);
+            return -1;
+        }
+        cursor += offset;
+
+        if (thisNode == node){
+            *lat = thisLat;
+            *lon = thisLon;
+        }
+
+        for (int i = 0; i < degree; i++){
+            int other;
+            if (sscanf(cursor, "%d%n", &other, &offset) != 1 || other < 0 || other >= numNodes){
+                fclose(file);
+                free(*neighbours);
+                return -1;
+            }
+            cursor += offset;
+
+            //adjacency is undirected, so both directions make a neighbour
+            if (thisNode == node && other != node)
+                count = addUnique(*neighbours, count, other);
+            else if (other == node && thisNode != node)
+                count = addUnique(*neighbours, count, thisNode);
+        }
+    }
+    fclose(file);
+    return count;
+}
+
+//Grid coordinates of node and its lat/lon (the grid coordinates, or the position in the topology file). Returns 0 on success, -1 on error
+static int nodePosition(int node, int ncols, int topologyType, const char *topologyPath, int coord[2], float latLon[2]){
+    coord[0] = node / ncols;
+    coord[1] = node % ncols;
+    latLon[0] = coord[0];
+    latLon[1] = coord[1];
+    if (topologyType == TOPOLOGY_FILE){
+        int *fileNeighbours;
+        if (topologyFileNeighbours(topologyPath, node, &fileNeighbours, &latLon[0], &latLon[1]) < 0)
+            return -1;
+        free(fileNeighbours);
+    }
+    return 0;
+}
+
+int createSensorGraph(MPI_Comm commSensors, int numNeighbours, int *neighbours, int ncols, int topologyType, const char *topologyPath, int *node, int coord[2], float latLon[2], MPI_Comm *commGraph, struct topology *topo){
+    int ierr, graphSize, indegree, outdegree, weighted;
+    int reorder = 1; //let MPI place the graph neighbours on the same node if it can
+
+    //Every edge has the same weight, so the placement only looks at which sensors are neighbours
+    int *weights = (int*)malloc((numNeighbours > 0 ? numNeighbours : 1) * sizeof(int));
+    for (int i = 0; i < numNeighbours; i++)
+        weights[i] = 1;
+
+    //Neighbours are both sources and destinations since sensors talk both ways
+    ierr = MPI_Dist_graph_create_adjacent(commSensors, numNeighbours, neighbours, weights, numNeighbours, neighbours, weights, MPI_INFO_NULL, reorder, commGraph);
+    free(weights);
+    if (ierr != MPI_SUCCESS)
+        return ierr;
+
+    MPI_Comm_size(*commGraph, &graphSize);
+
+    //The process is the node of its (possibly reordered) rank in the graph from now on
+    MPI_Comm_rank(*commGraph, node);
+    if (nodePosition(*node, ncols, topologyType, topologyPath, coord, latLon) != 0)
+        return MPI_ERR_OTHER;
+
+    //Get the neighbours of that node
+    MPI_Dist_graph_neighbors_count(*commGraph, &indegree, &outdegree, &weighted);
+    int *sources = (int*)malloc((indegree > 0 ? indegree : 1) * sizeof(int));
+    int *sourceWeights = (int*)malloc((indegree > 0 ? indegree : 1) * sizeof(int));
+    int *destWeights = (int*)malloc((outdegree > 0 ? outdegree : 1) * sizeof(int));
+    topo->neighbours = (int*)malloc((outdegree > 0 ? outdegree : 1) * sizeof(int));
+    MPI_Dist_graph_neighbors(*commGraph, indegree, sources, sourceWeights, outdegree, topo->neighbours, destWeights);
+    topo->numNeighbours = outdegree;
+    free(sources);
+    free(sourceWeights);
+    free(destWeights);
+
+    //Share the coordinates so a sensor can describe its neighbours in the alerts
+    topo->nodeCoords = (int*)malloc(2 * graphSize * sizeof(int));
+    MPI_Allgather(coord, 2, MPI_INT, topo->nodeCoords, 2, MPI_INT, *commGraph);
+
+    return MPI_SUCCESS;
+}
+
+void freeTopology(struct topology *topo){
+    free(topo->neighbours);
+    free(topo->nodeCoords);
+}
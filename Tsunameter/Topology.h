@@ -0,0 +1,53 @@
+#ifndef TOPOLOGY_H
+#define TOPOLOGY_H
+
+#include <mpi.h>
+
+//The different neighbourhoods a sensor can have
+#define TOPOLOGY_GRID4 0     //2D grid, 4 neighbours (up, down, left, right)
+#define TOPOLOGY_GRID8 1     //2D grid, 8 neighbours (including the diagonals)
+#define TOPOLOGY_RADIUS 2    //2D grid, every sensor within a radius r
+#define TOPOLOGY_FILE 3      //irregular deployment loaded from a topology file
+
+#define TOPOLOGY_PATH_SIZE 256
+
+//Information about the sensor network seen from one sensor.
+//The node id of a sensor (row major position in the grid / line in the file) is its rank in the graph
+//communicator, so the tables are indexed by it.
+struct topology{
+    int numNeighbours;   //number of neighbours of this sensor
+    int *neighbours;     //node ids (graph ranks) of the neighbours
+    int *nodeCoords;     //grid coordinates of every node, stored as (row, col) pairs
+};
+
+/**
+* Get the neighbours of node (row major index in a nrows x ncols grid) for one of the grid neighbourhoods.
+* The neighbours are stored in a newly allocated array. Returns the number of neighbours.
+**/
+int gridNeighbours(int node, int nrows, int ncols, int topologyType, int radius, int **neighbours);
+
+/**
+* Returns the number of nodes in the topology file, or -1 if the file can not be read.
+**/
+int topologyFileNodes(const char *path);
+
+/**
+* Read the neighbours and the lat/lon of node from the topology file. Adjacency is treated as undirected,
+* so a node is also a neighbour of every node which lists it. Returns the number of neighbours or -1 on error.
+**/
+int topologyFileNeighbours(const char *path, int node, int **neighbours, float *lat, float *lon);
+
+/**
+* Create the distributed graph communicator for the sensors with reordering enabled, so MPI can place
+* neighbouring sensors close to each other. The neighbours are the ones of the node of this process's rank
+* in commSensors. MPI may give the process another rank in the graph, and with it the edges of the node of
+* that rank, so node, coord and latLon are set for the rank in commGraph. Fills in the topology tables for this sensor.
+**/
+int createSensorGraph(MPI_Comm commSensors, int numNeighbours, int *neighbours, int ncols, int topologyType, const char *topologyPath, int *node, int coord[2], float latLon[2], MPI_Comm *commGraph, struct topology *topo);
+
+/**
+* Free the memory of the topology tables.
+**/
+void freeTopology(struct topology *topo);
+
+#endif
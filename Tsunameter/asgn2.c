@@ -12,35 +12,48 @@
 #include "HelperFunctions.h" //include the other dependencies
 #include "SensorSubroutine.h"
 #include "BaseStationSubroutine.h"
+#include "Topology.h"
+#include "Checkpoint.h"
 
-#define SHIFT_ROW 0
-#define SHIFT_COL 1
-#define DISP 1
 #define MIN_WATER_HEIGHT 5000.0    //the minimum water height that could be randomly generated
 #define MAX_WATER_HEIGHT 6800.0    //the maximum water height that could be randomly generated
 #define WATER_THRESHOLD 6000.0     // the water height which is classified as a possible event
 #define HEIGHT_TOLERANCE 200.0     //to count as similar
 #define TIME_TOLERANCE 10.0        //time to match the satellite and sensor readings
+#define SAMPLE_INTERVAL 5.0        //seconds between two water height samples of a sensor
+#define NEIGHBOUR_DEADLINE 2.0     //seconds to wait for the neighbours' averages (they answer as soon as the request arrives)
+#define NEIGHBOUR_QUORUM 0.5       //fraction of the neighbours that must reply to evaluate an alert
+#define NEIGHBOUR_AGREEMENT 0.5    //fraction of the neighbours that must report a similar height to raise an event (at least 1)
+#define DISARM_MARGIN 100.0        //default distance of the disarm threshold below the water threshold
+#define ALERT_SUMMARY_CYCLES 6     //cycles between the summaries sent to base during an ongoing event (30 seconds)
+#define CHECKPOINT_INTERVAL 5      //base iterations between two checkpoints (0 to disable)
+#define STATS_HALF_LIFE 120.0      //seconds for an alert to count half in the base station's decayed alert rates
+#define STATS_SNAPSHOT_INTERVAL 3  //base iterations between two snapshots of the sensor statistics in the log (0 to disable)
 
 //Message tags
 #define SEND_REQUEST_TAG 10        //tag used when sending/receiving the request for average
 #define SEND_AVG_TAG 11            //tag used when sending/receiving the average value
 #define SEND_ALERT_BASE_TAG 12     //tag used when sending/receiving the alert to base
 #define SEND_TERMINATION_TAG 13    //tag when terminating sensors
+#define SEND_STATUS_BASE_TAG 14    //tag used when sending/receiving the degraded/recovered status of a neighbour to base
+#define SEND_CHECKPOINT_TAG 15     //tag when the base tells the sensors to checkpoint
+#define SEND_HEARTBEAT_TAG 16      //tag of the heartbeat a sensor sends to its neighbours every cycle
 
 
 int main(int argc, char *argv[]) {
 
    
     float waterThreshold = 6000.0; //the default value for the water threshold. Can be adjusted by user input
-    int ndims=2, world_size, world_rank, reorder, my_cart_rank, ierr;
+    float disarmThreshold;         //an event is cleared below this water height. Can be adjusted by user input
+    int ndims=2, world_size, world_rank, ierr;
     int nrows, ncols, nbaseIters;
-    int nbr_i_lo, nbr_i_hi; //for up and down the neighbours 
-    int nbr_j_lo, nbr_j_hi; //left and right neighbours
+    int topologyType = TOPOLOGY_GRID4; //the neighbourhood of the sensors. Can be adjusted by user input
+    int radius = 1;                    //the radius for the radius-r neighbourhood
+    char topologyPath[TOPOLOGY_PATH_SIZE] = ""; //the topology file for irregular deployments
+    int restart = 0;                   //1 to continue from the checkpoint file. Run with the argument "restart"
 
-    MPI_Comm comm2D;    //for the virtual topology
+    MPI_Comm commGraph;    //for the virtual topology
     int dims[ndims],coord[ndims];
-    int wrap_around[ndims];
     
     //The group for world and for sensors
     MPI_Group group_world, group_sensors; 
@@ -66,6 +79,7 @@ int main(int argc, char *argv[]) {
     int userInputSuccessN = 0; 
     int userInputSuccessI = 0;
     int userInputSuccessT = 0; 
+    int userInputSuccessG = 0;
     int userDimError = 1;    //Keep track of any errors of user inputs
    
     //Root rank will get the user inputs. 
@@ -99,6 +113,39 @@ int main(int argc, char *argv[]) {
                 waterThreshold = WATER_THRESHOLD;
             }
             
+            //Get the disarm threshold for the hysteresis, so an average around the threshold does not raise an event every cycle
+            printf("Enter the disarm threshold value (below %.1f, else, default %.1f will be used) to clear an event (as float): \n", waterThreshold, waterThreshold - DISARM_MARGIN);
+            if (scanf("%f", &disarmThreshold) != 1){
+                printf("ERROR: Disarm threshold is not correct.\n");
+                userDimError = 1;
+            }
+            else if (disarmThreshold >= waterThreshold){
+                printf("WARNING: Disarm threshold not below the water threshold. Default value %.1f used.\n", waterThreshold - DISARM_MARGIN);
+                disarmThreshold = waterThreshold - DISARM_MARGIN;
+            }
+            
+            //Get the neighbourhood of the sensors
+            printf("Enter the sensor topology (%d = 4 neighbour grid, %d = 8 neighbour grid, %d = radius r grid, %d = topology file): \n", TOPOLOGY_GRID4, TOPOLOGY_GRID8, TOPOLOGY_RADIUS, TOPOLOGY_FILE);
+            userInputSuccessG = scanf("%d", &topologyType);
+            if (userInputSuccessG != 1 || topologyType < TOPOLOGY_GRID4 || topologyType > TOPOLOGY_FILE){
+                printf("ERROR: Topology type is not correct.\n");
+                userDimError = 1;
+            }
+            else if (topologyType == TOPOLOGY_RADIUS){
+                printf("Enter the radius r of the neighbourhood (as integer): \n");
+                if (scanf("%d", &radius) != 1 || radius < 1){
+                    printf("ERROR: Radius must be an integer of at least 1.\n");
+                    userDimError = 1;
+                }
+            }
+            else if (topologyType == TOPOLOGY_FILE){
+                printf("Enter the path of the topology file: \n");
+                if (scanf("%255s", topologyPath) != 1 || topologyFileNodes(topologyPath) != world_size-1){
+                    printf("ERROR: Topology file can not be read or does not have %d nodes.\n", world_size-1);
+                    userDimError = 1;
+                }
+            }
+            
             //Number of processes = number of rows * number of cols + 1 for the base station. 
             //Check if user input is not equals the number of processes specified in mpirun
             if( (nrows*ncols) != world_size -1) {
@@ -109,6 +156,16 @@ int main(int argc, char *argv[]) {
             dims[0] = nrows; /* number of rows */
             dims[1] = ncols; /* number of columns */
         }
+        
+        //Only restart if the checkpoint file was written for the same number of sensors
+        if (argc > 1 && strcmp(argv[1], "restart") == 0){
+            if (checkpointValid(world_size-1) == 0){
+                printf("Restarting from the checkpoint %s\n", CHECKPOINT_PATH);
+                restart = 1;
+            }
+            else
+                printf("WARNING: No checkpoint for %d sensors in %s. Starting fresh.\n", world_size-1, CHECKPOINT_PATH);
+        }
     }
     
     
@@ -116,7 +173,12 @@ int main(int argc, char *argv[]) {
     MPI_Bcast( &nrows, 1, MPI_INT, 0, MPI_COMM_WORLD);
     MPI_Bcast( &ncols, 1, MPI_INT, 0, MPI_COMM_WORLD);
     MPI_Bcast( &waterThreshold, 1, MPI_FLOAT, 0, MPI_COMM_WORLD);
+    MPI_Bcast( &disarmThreshold, 1, MPI_FLOAT, 0, MPI_COMM_WORLD);
     MPI_Bcast( dims, 2, MPI_INT, 0, MPI_COMM_WORLD);
+    MPI_Bcast( &topologyType, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    MPI_Bcast( &radius, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    MPI_Bcast( topologyPath, TOPOLOGY_PATH_SIZE, MPI_CHAR, 0, MPI_COMM_WORLD);
+    MPI_Bcast( &restart, 1, MPI_INT, 0, MPI_COMM_WORLD);
     
     
     
@@ -157,7 +219,7 @@ int main(int argc, char *argv[]) {
         if (world_rank == 0){
         
             //Perform the base station subroutine
-            baseStationSubroutine(waterThreshold, MAX_WATER_HEIGHT, nbaseIters, nrows, ncols, MPI_COMM_WORLD, SEND_ALERT_BASE_TAG, SEND_TERMINATION_TAG, nrows*ncols, HEIGHT_TOLERANCE, TIME_TOLERANCE ); 
+            baseStationSubroutine(waterThreshold, MAX_WATER_HEIGHT, nbaseIters, nrows, ncols, MPI_COMM_WORLD, SEND_ALERT_BASE_TAG, SEND_TERMINATION_TAG, SEND_STATUS_BASE_TAG, nrows*ncols, HEIGHT_TOLERANCE, TIME_TOLERANCE, SEND_CHECKPOINT_TAG, CHECKPOINT_INTERVAL, restart, STATS_HALF_LIFE, STATS_SNAPSHOT_INTERVAL ); 
         }
         
     } 
@@ -170,35 +232,39 @@ int main(int argc, char *argv[]) {
         
         /************************************************************
         */
-        /* create cartesian topology for the sensor nodes */
+        /* create the graph topology for the sensor nodes */
         /************************************************************
         */
-    
-        //Create dimensions based on user inputs
-        MPI_Dims_create(nrows*ncols, ndims, dims);
-    
-    
-        /* create cartesian mapping */
-        wrap_around[0] = wrap_around[1] = 0; //no wrap around for cartesian grid
-        reorder = 1;    
-        ierr =0;      //for error message
-        ierr = MPI_Cart_create(comm_sensors, ndims, dims, wrap_around, reorder, &comm2D); //create virtual topology
-        if(ierr != 0) printf("ERROR[%d] creating CART\n",ierr);
         
+        //The graph is described with the rank in the sensor group as node id. Grid coordinates are row major.
+        int numNeighbours;
+        int *neighbours;
+        int node;
+        float latLon[2];
         
-        /* find my coordinates in the cartesian communicator group */
-        MPI_Cart_coords(comm2D, comm_sensors_rank, ndims, coord); //pass rank to get coordinates
-        /* get my neighbors; axis is coordinate dimension of shift */
-        MPI_Cart_shift( comm2D, SHIFT_ROW, DISP, &nbr_i_lo, &nbr_i_hi);    //Get the top and bottom neighbours
-        MPI_Cart_shift( comm2D, SHIFT_COL, DISP, &nbr_j_lo, &nbr_j_hi);    //Get the left and right neighbours
-        //printf("Global rank: %d. Cart rank: %d. Coord: (%d, %d). Left: %d. Right: %d. Top: %d. Bottom: %d\n", world_rank, comm_sensors_rank, coord[0], coord[1], nbr_j_lo, nbr_j_hi, nbr_i_lo, nbr_i_hi);
-    
+        if (topologyType == TOPOLOGY_FILE){
+            numNeighbours = topologyFileNeighbours(topologyPath, comm_sensors_rank, &neighbours, &latLon[0], &latLon[1]);
+            if (numNeighbours < 0){
+                printf("ERROR: sensor %d could not read topology file %s\n", comm_sensors_rank, topologyPath);
+                MPI_Abort(MPI_COMM_WORLD, 1);
+            }
+        }
+        else
+            numNeighbours = gridNeighbours(comm_sensors_rank, nrows, ncols, topologyType, radius, &neighbours);
         
-        int neighbours[4] = {nbr_j_lo, nbr_j_hi, nbr_i_lo, nbr_i_hi};
+        //create distributed graph mapping (reorder enabled so neighbours can be placed together).
+        //The sensor is the node of its rank in the graph afterwards, with the coordinates and lat/lon of that node
+        struct topology topo;
+        ierr = createSensorGraph(comm_sensors, numNeighbours, neighbours, ncols, topologyType, topologyPath, &node, coord, latLon, &commGraph, &topo);
+        if(ierr != MPI_SUCCESS) printf("ERROR[%d] creating GRAPH\n",ierr);
+        free(neighbours);
+        //printf("Global rank: %d. Node: %d. Coord: (%d, %d). Neighbours: %d\n", world_rank, node, coord[0], coord[1], topo.numNeighbours);
         
          //Perform the sensor subroutine. Only the sensors will do this
-        sensorRoutine(comm_sensors_rank, coord, neighbours, MIN_WATER_HEIGHT, MAX_WATER_HEIGHT, waterThreshold, comm2D, MPI_COMM_WORLD, SEND_REQUEST_TAG, SEND_AVG_TAG, SEND_ALERT_BASE_TAG, SEND_TERMINATION_TAG, HEIGHT_TOLERANCE);    
+        sensorRoutine(node, coord, latLon, &topo, MIN_WATER_HEIGHT, MAX_WATER_HEIGHT, waterThreshold, commGraph, MPI_COMM_WORLD, SEND_REQUEST_TAG, SEND_AVG_TAG, SEND_ALERT_BASE_TAG, SEND_TERMINATION_TAG, SEND_STATUS_BASE_TAG, HEIGHT_TOLERANCE, NEIGHBOUR_DEADLINE, NEIGHBOUR_QUORUM, NEIGHBOUR_AGREEMENT, disarmThreshold, ALERT_SUMMARY_CYCLES, SAMPLE_INTERVAL, SEND_CHECKPOINT_TAG, SEND_HEARTBEAT_TAG, restart);    
         
+        freeTopology(&topo);
+        MPI_Comm_free( &commGraph );
     }
 
     //Clean up